@@ -7,7 +7,10 @@
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+//     btryread does the same for a cached block without waiting,
+//     and bprefetch reads a run of blocks ahead in one request.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bwritev to write several at once.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
@@ -102,6 +105,71 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return a locked buf with the contents of the indicated block
+// if it is cached and no other process has it locked; else 0.
+// Lets a caller that already holds buffers lock more of them
+// without risking a deadlock.
+struct buf*
+btryread(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      if(!b->valid || !tryacquiresleep(&b->lock))
+        break;
+      b->refcnt++;
+      release(&bcache.lock);
+      return b;
+    }
+  }
+  release(&bcache.lock);
+  return 0;
+}
+
+// Read blocks blockno..blockno+n-1 into the cache with a
+// single disk request, skipping ones that are cached already.
+// Read-ahead is a hint, so give up rather than wait for
+// buffers.
+void
+bprefetch(uint dev, uint blockno, int n)
+{
+  struct buf *bs[NREADAHEAD];
+  struct buf *b;
+  int i, m;
+
+  if(n > NREADAHEAD)
+    n = NREADAHEAD;
+  m = 0;
+  acquire(&bcache.lock);
+  for(i = 0; i < n; i++){
+    for(b = bcache.head.next; b != &bcache.head; b = b->next)
+      if(b->dev == dev && b->blockno == blockno + i)
+        break;
+    if(b != &bcache.head)
+      continue;
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev)
+      if(b->refcnt == 0)
+        break;
+    if(b == &bcache.head || !tryacquiresleep(&b->lock))
+      break;
+    b->dev = dev;
+    b->blockno = blockno + i;
+    b->valid = 0;
+    b->refcnt = 1;
+    bs[m++] = b;
+  }
+  release(&bcache.lock);
+
+  if(m > 0)
+    virtio_disk_rwv(bs, m, 0);
+  for(i = 0; i < m; i++){
+    bs[i]->valid = 1;
+    brelse(bs[i]);
+  }
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,6 +179,17 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write n locked buffers to disk, letting the disk
+// scheduler merge the ones that are adjacent on disk.
+void
+bwritev(struct buf **bs, int n)
+{
+  for(int i = 0; i < n; i++)
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+  virtio_disk_rwv(bs, n, 1);
+}
+
 // Release a locked buffer.
 // Move to the head of the most-recently-used list.
 void
@@ -7,6 +7,9 @@ struct buf {
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
+  struct buf *qnext; // disk request queue
+  int qwrite;        // queued request writes the disk
+  uint deadline;     // tick by which the request should be dispatched
   uchar data[BSIZE];
 };
 
@@ -0,0 +1,119 @@
+// Directory entry cache.
+//
+// Maps (device, directory i-number, name) to the i-number the
+// name refers to, or to 0 if the directory has no such entry
+// (a negative entry), so that namex() can resolve a path
+// element without scanning the directory with readi().
+//
+// A directory's entries are only looked up and changed with
+// the directory's inode locked, so they agree with its
+// contents: dirlink() and unlink update them, and the entries
+// of a directory are dropped when its inode is freed.
+//
+// The cache is a hash table of NDHASH sets of NDWAY entries;
+// each set replaces its entries round-robin.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "fs.h"
+
+#define NDHASH 64
+#define NDWAY  4
+
+struct dentry {
+  uint dev;
+  uint dinum;  // directory's i-number, 0 if unused
+  uint inum;   // 0 for a negative entry
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry set[NDHASH][NDWAY];
+  uchar next[NDHASH];  // next entry of the set to replace
+} dcache;
+
+void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static int
+dhash(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dinum;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for name in set h. Caller holds dcache.lock.
+static struct dentry*
+dfind(int h, uint dev, uint dinum, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.set[h]; d < dcache.set[h] + NDWAY; d++)
+    if(d->dinum == dinum && d->dev == dev &&
+       strncmp(d->name, name, DIRSIZ) == 0)
+      return d;
+  return 0;
+}
+
+// Look up name in directory dinum. On a hit, set *inum
+// (0 if the directory has no such entry) and return 1.
+int
+dcachelookup(uint dev, uint dinum, char *name, uint *inum)
+{
+  struct dentry *d;
+
+  if(FSLINEAR)
+    return 0;
+  acquire(&dcache.lock);
+  d = dfind(dhash(dev, dinum, name), dev, dinum, name);
+  if(d)
+    *inum = d->inum;
+  release(&dcache.lock);
+  return d != 0;
+}
+
+// Record that name in directory dinum refers to inum,
+// or, if inum is 0, that there is no such entry.
+void
+dcacheenter(uint dev, uint dinum, char *name, uint inum)
+{
+  struct dentry *d;
+  int h;
+
+  h = dhash(dev, dinum, name);
+  acquire(&dcache.lock);
+  if((d = dfind(h, dev, dinum, name)) == 0){
+    d = &dcache.set[h][dcache.next[h]];
+    dcache.next[h] = (dcache.next[h] + 1) % NDWAY;
+    d->dev = dev;
+    d->dinum = dinum;
+    strncpy(d->name, name, DIRSIZ);
+  }
+  d->inum = inum;
+  release(&dcache.lock);
+}
+
+// Drop the entries of directory dinum, which is being freed.
+void
+dcachepurge(uint dev, uint dinum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.set[0]; d < dcache.set[0] + NDHASH*NDWAY; d++)
+    if(d->dinum == dinum && d->dev == dev)
+      d->dinum = 0;
+  release(&dcache.lock);
+}
@@ -2,7 +2,11 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct page;
 struct pipe;
+struct pollfd;
+struct pollq;
 struct proc;
 struct spinlock;
 struct sleeplock;
@@ -12,8 +16,11 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     btryread(uint, uint);
+void            bprefetch(uint, uint, int);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
 
@@ -22,6 +29,12 @@ void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// dcache.c
+void            dcacheinit(void);
+int             dcachelookup(uint, uint, char*, uint*);
+void            dcacheenter(uint, uint, char*, uint);
+void            dcachepurge(uint, uint);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -31,8 +44,16 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int, uint*);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filepoll(struct file*, int, struct pollq**);
+int             filegetfl(struct file*);
+int             fileruns(struct file*);
+int             filesetfl(struct file*, int);
+int             filecopy(struct file*, uint*, struct file*, uint*, int);
+int             filesplice(struct file*, uint*, struct file*, uint*, int);
+int             filewritev(struct file*, struct iovec*, int, uint*);
 
 // fs.c
 void            fsinit(int);
@@ -42,6 +63,7 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
+void            iplace(struct inode*, struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -51,6 +73,7 @@ struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
+uint            iruns(struct inode*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 
@@ -68,13 +91,37 @@ void            kinit(void);
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
+void            end_opn(int);
+int             log_opmax(void);
+void            log_sync(void);
+
+// pcache.c
+void            pcinit(void);
+struct page*    pcget(uint, uint, uint);
+struct page*    pclookup(uint, uint, uint);
+void            pcrelse(struct page*);
+void            pcdrop(uint, uint);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, int, uint64, int, int);
+int             pipewrite(struct pipe*, int, uint64, int, int);
+int             pipesize(struct pipe*);
+int             pipepoll(struct pipe*, int, int, struct pollq**);
+int             piperesize(struct pipe*, int);
+char*           pipebeginread(struct pipe*, int, int*);
+void            pipeendread(struct pipe*, int);
+char*           pipebeginwrite(struct pipe*, int, int*);
+void            pipeendwrite(struct pipe*, int);
+
+// poll.c
+void            pollinit(void);
+void            pollwait(struct pollq*);
+void            pollwakeup(struct pollq*);
+int             dopoll(struct pollfd*, int, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -89,6 +136,7 @@ int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             kproc(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -116,8 +164,16 @@ void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// shm.c
+void            shminit(void);
+uint64          shmattach(char*, int, int);
+int             shmdetach(uint64);
+int             shmfork(struct proc*, struct proc*);
+void            shmfree(struct proc*, pagetable_t);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
@@ -181,6 +237,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwv(struct buf **, int, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
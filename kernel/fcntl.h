@@ -3,3 +3,16 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_EXTENT  0x800
+#define O_NONBLOCK 0x1000
+
+// returned by a read or write of an O_NONBLOCK file
+// that would otherwise have to wait.
+#define EWOULDBLOCK (-2)
+
+// fcntl commands
+#define F_GETPIPE_SZ 1  // capacity of a pipe in bytes
+#define F_SETPIPE_SZ 2  // set it to at least arg bytes
+#define F_GETFL      3  // file status flags (O_NONBLOCK)
+#define F_SETFL      4  // set them to arg
+#define F_GETRUNS    5  // runs of contiguous data blocks; slow
@@ -12,6 +12,9 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "uio.h"
+#include "poll.h"
+#include "fcntl.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -35,6 +38,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->nonblock = 0;
       release(&ftable.lock);
       return f;
     }
@@ -101,27 +105,114 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
+// Read inode file f at *offp into the cnt buffers iov, with
+// the inode locked once, advancing *offp past the bytes read.
+// Stops at the end of the file. The buffers are user addresses
+// if user is 1, kernel addresses otherwise.
+static int
+readiv(struct file *f, int user, struct iovec *iov, int cnt, uint *offp)
+{
+  int i, r, tot = 0;
+
+  ilock(f->ip);
+  for(i = 0; i < cnt; i++){
+    r = readi(f->ip, user, (uint64)iov[i].iov_base, *offp, iov[i].iov_len);
+    if(r > 0){
+      *offp += r;
+      tot += r;
+    }
+    if(r != iov[i].iov_len)
+      break;
+  }
+  iunlock(f->ip);
+  return tot;
+}
+
+// Write the cnt buffers iov to inode file f at *offp, advancing
+// *offp past the bytes written. The buffers fill one contiguous
+// range of the file, so a transaction sized for a single
+// write() can cover as many of them as fit.
+static int
+writeiv(struct file *f, int user, struct iovec *iov, int cnt, uint *offp)
+{
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int nlog = log_opmax();
+  int max = ((nlog-1-1-2) / 2) * BSIZE;
+  int i = 0, done = 0, tot = 0, room, n1, r = 0;
+
+  while(i < cnt){
+    begin_opn(nlog);
+    ilock(f->ip);
+    for(room = max; i < cnt && room > 0; room -= n1){
+      n1 = iov[i].iov_len - done;
+      if(n1 > room)
+        n1 = room;
+      r = writei(f->ip, user, (uint64)iov[i].iov_base + done, *offp, n1);
+      if(r < 0)
+        break;
+      if(r != n1)
+        panic("short filewrite");
+      *offp += r;
+      tot += r;
+      done += r;
+      if(done == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+    }
+    iunlock(f->ip);
+    end_opn(nlog);
+
+    if(r < 0)
+      return -1;
+  }
+  return tot;
+}
+
+// Return which of events (POLLIN, POLLOUT) are ready on file
+// f, plus POLLHUP if f is a pipe whose other end is closed.
+// A pipe or pollable device also adds the calling process to
+// its wait queue and sets *qp to it.
 int
-fileread(struct file *f, uint64 addr, int n)
+filepoll(struct file *f, int events, struct pollq **qp)
+{
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable, events, qp);
+  if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV &&
+     devsw[f->major].poll)
+    return devsw[f->major].poll(events, qp) & events;
+  // files never block.
+  return events & ((f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0));
+}
+
+// Read from file f, at *offp if it is an inode.
+// addr is a user virtual address if user is 1,
+// a kernel address otherwise. If nonblock is set, a pipe
+// or device does not wait for data even if f would.
+static int
+rdfile(struct file *f, int user, uint64 addr, int n, uint *offp, int nonblock)
 {
   int r = 0;
+  struct iovec iov;
 
   if(f->readable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, user, addr, n, f->nonblock || nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    r = devsw[f->major].read(user, addr, n, f->nonblock || nonblock);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    iov.iov_base = (void*)addr;
+    iov.iov_len = n;
+    r = readiv(f, user, &iov, 1, offp);
   } else {
     panic("fileread");
   }
@@ -129,50 +220,28 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
-// Write to file f.
-// addr is a user virtual address.
-int
-filewrite(struct file *f, uint64 addr, int n)
+// Write to file f, at *offp if it is an inode.
+// addr is a user virtual address if user is 1,
+// a kernel address otherwise.
+static int
+wrfile(struct file *f, int user, uint64 addr, int n, uint *offp)
 {
-  int r, ret = 0;
+  int ret = 0;
+  struct iovec iov;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, user, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
+    ret = devsw[f->major].write(user, addr, n, f->nonblock);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    iov.iov_base = (void*)addr;
+    iov.iov_len = n;
+    ret = writeiv(f, user, &iov, 1, offp);
   } else {
     panic("filewrite");
   }
@@ -180,3 +249,216 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Read from file f.
+// addr is a user virtual address.
+int
+fileread(struct file *f, uint64 addr, int n)
+{
+  return rdfile(f, 1, addr, n, &f->off, 0);
+}
+
+// Write to file f.
+// addr is a user virtual address.
+int
+filewrite(struct file *f, uint64 addr, int n)
+{
+  return wrfile(f, 1, addr, n, &f->off);
+}
+
+// Return the status flags of file f.
+int
+filegetfl(struct file *f)
+{
+  return f->nonblock ? O_NONBLOCK : 0;
+}
+
+// Set the status flags of file f; only O_NONBLOCK can change.
+int
+filesetfl(struct file *f, int flags)
+{
+  f->nonblock = (flags & O_NONBLOCK) != 0;
+  return 0;
+}
+
+// Return the number of runs of contiguous blocks holding
+// the data of file f, to measure fragmentation.
+int
+fileruns(struct file *f)
+{
+  int n;
+
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  n = iruns(f->ip);
+  iunlock(f->ip);
+  return n;
+}
+
+// Read from file f into the cnt user buffers iov, filling each
+// before the next. If offp is not 0, read from offset *offp
+// instead of f->off, leaving both unchanged. A pipe or device
+// only waits until there is some data, as read does.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt, uint *offp)
+{
+  int i, r, tot = 0;
+  uint off;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    if(offp == 0)
+      return readiv(f, 1, iov, cnt, &f->off);
+    off = *offp;
+    return readiv(f, 1, iov, cnt, &off);
+  }
+  if(offp)
+    return -1;  // pipes and devices have no offset
+
+  for(i = 0; i < cnt; i++){
+    r = rdfile(f, 1, (uint64)iov[i].iov_base, iov[i].iov_len, &f->off,
+               tot > 0);
+    if(r < 0)
+      return tot > 0 ? tot : r;
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Write the cnt user buffers iov to file f, in order. If offp
+// is not 0, write at offset *offp instead of f->off, leaving
+// both unchanged.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt, uint *offp)
+{
+  int i, r, tot = 0;
+  uint off;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    if(offp == 0)
+      return writeiv(f, 1, iov, cnt, &f->off);
+    off = *offp;
+    return writeiv(f, 1, iov, cnt, &off);
+  }
+  if(offp)
+    return -1;
+
+  for(i = 0; i < cnt; i++){
+    r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len);
+    if(r < 0)
+      return tot > 0 ? tot : r;
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Copy up to n bytes from file in to file out through a kernel
+// buffer, so that the data makes no trip through user space.
+// inoff and outoff, if not 0, give the offsets to use instead
+// of the files' own, and are advanced past the bytes copied.
+// Stops early when a read comes up short, at the end of an
+// input file or when a pipe has no more data ready.
+// Returns the number of bytes copied.
+int
+filecopy(struct file *out, uint *outoff, struct file *in, uint *inoff, int n)
+{
+  char *buf;
+  int r = 0, m, tot = 0;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if((inoff && in->type != FD_INODE) || (outoff && out->type != FD_INODE))
+    return -1;
+  if(inoff == 0)
+    inoff = &in->off;
+  if(outoff == 0)
+    outoff = &out->off;
+  if((buf = kalloc()) == 0)
+    return -1;
+
+  while(tot < n){
+    m = n - tot;
+    if(m > PGSIZE)
+      m = PGSIZE;
+    if((r = rdfile(in, 0, (uint64)buf, m, inoff, 0)) <= 0)
+      break;
+    if(wrfile(out, 0, (uint64)buf, r, outoff) != r){
+      r = -1;
+      break;
+    }
+    tot += r;
+    if(r < m)
+      break;
+  }
+  kfree(buf);
+  if(tot == 0 && r < 0)
+    return r;
+  return tot;
+}
+
+// Move up to n bytes from file in to file out, one of which
+// must be a pipe, copying straight between the pipe's ring and
+// the other file. Offsets are as for filecopy(). Waits only
+// for the first bytes, so that like read() it returns what a
+// pipe has ready. Returns the number of bytes moved.
+int
+filesplice(struct file *out, uint *outoff, struct file *in, uint *inoff, int n)
+{
+  char *p;
+  int m, r = 0, tot = 0;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if((inoff && in->type != FD_INODE) || (outoff && out->type != FD_INODE))
+    return -1;
+  if(inoff == 0)
+    inoff = &in->off;
+  if(outoff == 0)
+    outoff = &out->off;
+
+  if(in->type == FD_PIPE){
+    if(out->type == FD_PIPE && out->pipe == in->pipe)
+      return -1;
+    while(tot < n){
+      if((p = pipebeginread(in->pipe, tot == 0 && !in->nonblock, &m)) == 0){
+        r = m;
+        break;
+      }
+      if(m > n - tot)
+        m = n - tot;
+      r = wrfile(out, 0, (uint64)p, m, outoff);
+      pipeendread(in->pipe, r > 0 ? r : 0);
+      if(r <= 0)
+        break;
+      tot += r;
+    }
+  } else if(out->type == FD_PIPE){
+    while(tot < n){
+      if((p = pipebeginwrite(out->pipe, tot == 0 && !out->nonblock, &m)) == 0){
+        r = m;
+        break;
+      }
+      if(m > n - tot)
+        m = n - tot;
+      r = rdfile(in, 0, (uint64)p, m, inoff, 0);
+      pipeendwrite(out->pipe, r > 0 ? r : 0);
+      if(r <= 0)
+        break;
+      tot += r;
+      if(r < m)
+        break;
+    }
+  } else {
+    return -1;
+  }
+  if(tot == 0 && r < 0)
+    return r;
+  return tot;
+}
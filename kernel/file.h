@@ -3,6 +3,7 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: fail reads and writes that would sleep
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
@@ -18,6 +19,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext;  // hash chain
+  struct inode *fnext, *fprev; // free list, if ref == 0
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,13 +29,31 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint flags;
+  uint addrs[NDIRECT+3];
+
+  uint goal;             // block to try to allocate next
+  uint xlbn, xpbn, xlen; // extent lookup hint: the last extent used
+  uint xblk;             // block holding it, 0 if in addrs[]
+  int xidx;              // and its index there
+};
+
+// processes waiting in poll() for a pipe or device to change.
+#define NPOLLQ 4
+struct pollq {
+  int n;
+  struct proc *proc[NPOLLQ];
 };
 
 // map major device number to device functions.
+// read and write return EWOULDBLOCK rather than sleep if
+// their last argument is set. poll, if set, returns the ready
+// POLL events after adding the caller to the device's wait
+// queue, which it returns.
 struct devsw {
-  int (*read)(int, uint64, int);
-  int (*write)(int, uint64, int);
+  int (*read)(int, uint64, int, int);
+  int (*write)(int, uint64, int, int);
+  int (*poll)(int, struct pollq**);
 };
 
 extern struct devsw devsw[];
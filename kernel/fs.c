@@ -20,12 +20,16 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "pcache.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
 
+static void bsuminit(int);
+static void imapinit(int);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -43,7 +47,11 @@ fsinit(int dev) {
   readsb(dev, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  if(sb.bsize != BSIZE)
+    panic("file system block size");
   initlog(dev, &sb);
+  bsuminit(dev);
+  imapinit(dev);
 }
 
 // Zero a block.
@@ -59,32 +67,136 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// The disk is divided into groups of BGSIZE blocks, and an
+// in-memory summary keeps the number of free blocks in each,
+// built from the bitmap at boot and kept up to date by balloc
+// and bfree. balloc searches from a goal block, usually the
+// one after the file's last block, and skips groups that the
+// summary says are full.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+#define BGSIZE  1024  // blocks per allocation group
+#define NBGROUP ((FSSIZE + BGSIZE - 1) / BGSIZE)
+
+struct {
+  struct spinlock lock;
+  int ngroups;
+  int nfree[NBGROUP];  // free blocks per group
+} bsum;
+
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b;
 
+  initlock(&bsum.lock, "bsum");
+  bsum.ngroups = (sb.size + BGSIZE - 1) / BGSIZE;
+  if(bsum.ngroups > NBGROUP)
+    panic("bsuminit: file system too big");
   bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
+  for(b = 0; b < sb.size; b++){
+    if(b % BPB == 0){
+      if(bp)
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+      bp = bread(dev, BBLOCK(b, sb));
     }
+    if((bp->data[(b % BPB)/8] & (1 << (b % 8))) == 0)
+      bsum.nfree[b / BGSIZE]++;
+  }
+  if(bp)
     brelse(bp);
+}
+
+static void
+bsumadd(uint b, int n)
+{
+  acquire(&bsum.lock);
+  bsum.nfree[b / BGSIZE] += n;
+  release(&bsum.lock);
+}
+
+// Allocate the first free block in [from, to), which lie
+// in one group; returns 0 if there is none.
+static uint
+balloc_range(uint dev, uint from, uint to)
+{
+  struct buf *bp;
+  uint b;
+  int bi, m;
+
+  if(to > sb.size)
+    to = sb.size;
+  if(from >= to)
+    return 0;
+  bp = bread(dev, BBLOCK(from, sb));
+  for(b = from; b < to; b++){
+    bi = b % BPB;
+    if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+      b += 7;  // skip a full byte
+      continue;
+    }
+    m = 1 << (bi % 8);
+    if((bp->data[bi/8] & m) == 0){  // Is block free?
+      bp->data[bi/8] |= m;  // Mark block in use.
+      log_write(bp);
+      brelse(bp);
+      bsumadd(b, -1);
+      bzero(dev, b);
+      return b;
+    }
+  }
+  brelse(bp);
+  return 0;
+}
+
+// Allocate a zeroed disk block, as close after goal as possible.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint b, from, to;
+  int g, k, n;
+
+  if(goal < sb.bmapstart || goal >= sb.size)
+    goal = sb.bmapstart;
+  n = bsum.ngroups;
+  // the rest of goal's group, the groups after it, and
+  // finally the start of goal's group.
+  for(k = 0; k <= n; k++){
+    g = (goal / BGSIZE + k) % n;
+    from = k == 0 ? goal : g * BGSIZE;
+    to = k == n ? goal : (g + 1) * BGSIZE;
+    if(bsum.nfree[g] > 0 && (b = balloc_range(dev, from, to)) != 0)
+      return b;
   }
   panic("balloc: out of blocks");
 }
 
+// Allocate disk block b if it is free, so that a file can
+// grow in place; returns 0 if b is in use.
+static uint
+balloc_at(uint dev, uint b)
+{
+  struct buf *bp;
+  int bi, m;
+
+  if(b >= sb.size)
+    return 0;
+  bp = bread(dev, BBLOCK(b, sb));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  if(bp->data[bi/8] & m){
+    brelse(bp);
+    return 0;
+  }
+  bp->data[bi/8] |= m;
+  log_write(bp);
+  brelse(bp);
+  bsumadd(b, -1);
+  bzero(dev, b);
+  return b;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -100,6 +212,7 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  bsumadd(b, 1);
 }
 
 // Inodes.
@@ -162,18 +275,33 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// The cache is a hash table keyed by (dev, inum), with a
+// spin-lock per bucket so that lookups of different inodes
+// don't contend. Entries are allocated a page at a time, up to
+// NINODE of them. An entry whose ip->ref drops to zero stays in
+// its bucket, still valid, and goes on a free list; iget()
+// recycles the one that has been free the longest.
+//
+// A bucket's lock protects ip->ref, ip->dev, ip->inum and the
+// hash chain of the entries in that bucket; one must hold it
+// while using any of those fields. The icache.lock spin-lock
+// protects the free list and the allocation of entries, and is
+// taken after a bucket lock when both are needed.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode free;  // free list; free.fnext has been free longest
+  int n;              // entries allocated
+  struct {
+    struct spinlock lock;
+    struct inode *head;
+  } bucket[NIHASH];
 } icache;
 
 void
@@ -182,36 +310,169 @@ iinit()
   int i = 0;
   
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
+  icache.free.fnext = icache.free.fprev = &icache.free;
+  for(i = 0; i < NIHASH; i++) {
+    initlock(&icache.bucket[i].lock, "icache bucket");
   }
 }
 
+static int
+ihash(uint dev, uint inum)
+{
+  return (dev * 31 + inum) % NIHASH;
+}
+
+// Free list operations; caller holds icache.lock.
+static void
+ifree_add(struct inode *ip)
+{
+  ip->fnext = &icache.free;
+  ip->fprev = icache.free.fprev;
+  icache.free.fprev->fnext = ip;
+  icache.free.fprev = ip;
+}
+
+static void
+ifree_del(struct inode *ip)
+{
+  ip->fprev->fnext = ip->fnext;
+  ip->fnext->fprev = ip->fprev;
+  ip->fnext = ip->fprev = 0;
+}
+
+// Put a page worth of new entries on the free list, unless
+// NINODE have been allocated. Caller holds icache.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  char *page;
+  int i;
+
+  if(icache.n >= NINODE || (page = kalloc()) == 0)
+    return -1;
+  memset(page, 0, PGSIZE);
+  ip = (struct inode*)page;
+  for(i = 0; i < PGSIZE / sizeof(*ip) && icache.n < NINODE; i++, ip++){
+    initsleeplock(&ip->lock, "inode");
+    ifree_add(ip);
+    icache.n++;
+  }
+  return 0;
+}
+
 static struct inode* iget(uint dev, uint inum);
 
+// Free-inode map, kept in memory: a bit per inode, set if the
+// inode is in use. It is built from the inode blocks at boot
+// and changes together with the dinode's type, which is what
+// the log records, so it needs no logging of its own. A rotor
+// remembers where the last free inode was found.
+struct {
+  struct spinlock lock;
+  uint64 *map;
+  int nwords;
+  int rotor;
+} imap;
+
+static void
+imapset(uint inum, int used)
+{
+  acquire(&imap.lock);
+  if(used)
+    imap.map[inum / 64] |= 1L << (inum % 64);
+  else
+    imap.map[inum / 64] &= ~(1L << (inum % 64));
+  release(&imap.lock);
+}
+
+static void
+imapinit(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  uint inum;
+
+  initlock(&imap.lock, "imap");
+  imap.nwords = (sb.ninodes + 63) / 64;
+  if(imap.nwords * sizeof(uint64) > PGSIZE)
+    panic("imapinit: too many inodes");
+  if((imap.map = kalloc()) == 0)
+    panic("imapinit: kalloc");
+  memset(imap.map, 0, PGSIZE);
+  // inode 0 and numbers past the end are never free.
+  imap.map[0] = 1;
+  for(inum = sb.ninodes; inum < imap.nwords * 64; inum++)
+    imap.map[inum / 64] |= 1L << (inum % 64);
+  bp = 0;
+  for(inum = 1; inum < sb.ninodes; inum++){
+    if(bp == 0 || inum % IPB == 0){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, IBLOCK(inum, sb));
+    }
+    dip = (struct dinode*)bp->data + inum%IPB;
+    if(dip->type != 0)
+      imap.map[inum / 64] |= 1L << (inum % 64);
+  }
+  if(bp)
+    brelse(bp);
+}
+
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int inum, w, i;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
+  if(FSLINEAR){
+    // the old way, kept as a baseline for manybench.
+    for(inum = 1; inum < sb.ninodes; inum++){
+      bp = bread(dev, IBLOCK(inum, sb));
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(dip->type == 0){  // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        imapset(inum, 1);
+        return iget(dev, inum);
+      }
       brelse(bp);
-      return iget(dev, inum);
     }
-    brelse(bp);
+    panic("ialloc: no inodes");
+  }
+
+  // find and claim a free inode in the map.
+  acquire(&imap.lock);
+  inum = 0;
+  for(i = 0; i < imap.nwords; i++){
+    w = (imap.rotor + i) % imap.nwords;
+    if(~imap.map[w]){
+      for(inum = w * 64; imap.map[w] & (1L << (inum % 64)); inum++)
+        ;
+      imap.map[w] |= 1L << (inum % 64);
+      imap.rotor = w;
+      break;
+    }
   }
-  panic("ialloc: no inodes");
+  release(&imap.lock);
+  if(inum == 0)
+    panic("ialloc: no inodes");
+
+  bp = bread(dev, IBLOCK(inum, sb));
+  dip = (struct dinode*)bp->data + inum%IPB;
+  if(dip->type != 0)
+    panic("ialloc: inode in use");
+  memset(dip, 0, sizeof(*dip));
+  dip->type = type;
+  log_write(bp);   // mark it allocated on the disk
+  brelse(bp);
+  return iget(dev, inum);
 }
 
 // Copy a modified in-memory inode to disk.
@@ -231,11 +492,66 @@ iupdate(struct inode *ip)
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
+  dip->flags = ip->flags;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
 }
 
+// Look for an inode in bucket h; caller holds its lock.
+static struct inode*
+ifind(int h, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = icache.bucket[h].head; ip; ip = ip->hnext)
+    if(ip->dev == dev && ip->inum == inum)
+      return ip;
+  return 0;
+}
+
+// Take the entry that has been free the longest off the free
+// list and out of its bucket, growing the cache if the list is
+// empty. Returns an entry that is in no bucket.
+static struct inode*
+irecycle(void)
+{
+  struct inode *ip, **pp;
+  int h;
+
+  for(;;){
+    acquire(&icache.lock);
+    if(icache.free.fnext == &icache.free && igrow() < 0)
+      panic("iget: no inodes");
+    ip = icache.free.fnext;
+    if(ip->inum == 0){  // in no bucket
+      ifree_del(ip);
+      release(&icache.lock);
+      return ip;
+    }
+    h = ihash(ip->dev, ip->inum);
+    release(&icache.lock);
+
+    // take the locks in order, then check that ip is
+    // still free and in bucket h.
+    acquire(&icache.bucket[h].lock);
+    acquire(&icache.lock);
+    if(ip->fnext && ip->inum != 0 && ihash(ip->dev, ip->inum) == h){
+      ifree_del(ip);
+      release(&icache.lock);
+      for(pp = &icache.bucket[h].head; *pp != ip; pp = &(*pp)->hnext)
+        ;
+      *pp = ip->hnext;
+      ip->hnext = 0;
+      ip->dev = ip->inum = 0;
+      release(&icache.bucket[h].lock);
+      return ip;
+    }
+    release(&icache.lock);
+    release(&icache.bucket[h].lock);
+  }
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
@@ -243,32 +559,39 @@ static struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
+  int h = ihash(dev, inum);
 
-  acquire(&icache.lock);
+  acquire(&icache.bucket[h].lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
+  if((ip = ifind(h, dev, inum)) == 0){
+    // Recycle an inode cache entry.
+    release(&icache.bucket[h].lock);
+    empty = irecycle();
+    acquire(&icache.bucket[h].lock);
+    if((ip = ifind(h, dev, inum)) == 0){
+      ip = empty;
+      ip->dev = dev;
+      ip->inum = inum;
+      ip->ref = 1;
+      ip->valid = 0;
+      ip->hnext = icache.bucket[h].head;
+      icache.bucket[h].head = ip;
+      release(&icache.bucket[h].lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    // cached by someone else meanwhile.
+    acquire(&icache.lock);
+    ifree_add(empty);
+    release(&icache.lock);
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
-  ip->dev = dev;
-  ip->inum = inum;
-  ip->ref = 1;
-  ip->valid = 0;
-  release(&icache.lock);
-
+  if(ip->ref++ == 0){
+    acquire(&icache.lock);
+    ifree_del(ip);
+    release(&icache.lock);
+  }
+  release(&icache.bucket[h].lock);
   return ip;
 }
 
@@ -277,9 +600,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
+  int h = ihash(ip->dev, ip->inum);
+
+  acquire(&icache.bucket[h].lock);
   ip->ref++;
-  release(&icache.lock);
+  release(&icache.bucket[h].lock);
   return ip;
 }
 
@@ -304,7 +629,10 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
+    ip->flags = dip->flags;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->goal = 0;
+    ip->xlen = 0;
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -332,7 +660,9 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&icache.lock);
+  int h = ihash(ip->dev, ip->inum);
+
+  acquire(&icache.bucket[h].lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -341,20 +671,27 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&icache.lock);
+    release(&icache.bucket[h].lock);
 
     itrunc(ip);
+    if(ip->type == T_DIR)
+      dcachepurge(ip->dev, ip->inum);
     ip->type = 0;
     iupdate(ip);
+    imapset(ip->inum, 0);
     ip->valid = 0;
 
     releasesleep(&ip->lock);
 
-    acquire(&icache.lock);
+    acquire(&icache.bucket[h].lock);
   }
 
-  ip->ref--;
-  release(&icache.lock);
+  if(--ip->ref == 0){
+    acquire(&icache.lock);
+    ifree_add(ip);
+    release(&icache.lock);
+  }
+  release(&icache.bucket[h].lock);
 }
 
 // Common idiom: unlock, then put.
@@ -365,43 +702,262 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+// Choose where the blocks of a new inode ip, created in
+// directory dp, go: a file's next to its directory's, and a
+// new directory's in the group with the most free blocks, so
+// that unrelated trees spread out over the disk.
+void
+iplace(struct inode *ip, struct inode *dp)
+{
+  int g, best;
+
+  if(ip->type == T_DIR){
+    best = 0;
+    acquire(&bsum.lock);
+    for(g = 1; g < bsum.ngroups; g++)
+      if(bsum.nfree[g] > bsum.nfree[best])
+        best = g;
+    release(&bsum.lock);
+    ip->goal = best * BGSIZE;
+  } else {
+    ip->goal = dp->goal ? dp->goal : dp->addrs[0];
+  }
+}
+
 // Inode content
 //
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// blocks hang off the doubly-indirect block ip->addrs[NDIRECT+1],
+// which lists indirect blocks, and the next NTINDIRECT off the
+// triply-indirect block ip->addrs[NDIRECT+2].
+//
+// An inode with D_EXTENT set lists extents instead (see fs.h).
+
+// Allocate a block for inode ip near its goal, and move the
+// goal past it. An inode that has no goal (one that was not
+// just created) starts in the group its inode number maps to.
+static uint
+iballoc(struct inode *ip)
+{
+  uint b;
+
+  if(ip->goal == 0)
+    ip->goal = sb.bmapstart +
+      (uint64)ip->inum * (sb.size - sb.bmapstart) / sb.ninodes;
+  b = balloc(ip->dev, ip->goal);
+  ip->goal = b + 1;
+  return b;
+}
+
+// Return the disk block address of the nth block in extent
+// inode ip. Files have no holes, so a block that is not mapped
+// yet is the one just past the end; it is allocated right
+// after the last extent if possible, and otherwise starts a
+// new extent. Lookups start from the last extent used, so
+// sequential access does not search the map.
+static uint
+xmap(struct inode *ip, uint bn)
+{
+  uint addr, lbn, blk, *a, *link;
+  struct buf *bp;
+  int i, n;
+
+  if(ip->xlen && bn - ip->xlbn < ip->xlen)
+    return ip->xpbn + (bn - ip->xlbn);
+
+  if(ip->xlen && bn >= ip->xlbn){
+    lbn = ip->xlbn;
+    blk = ip->xblk;
+    i = ip->xidx;
+  } else {
+    lbn = blk = i = 0;
+  }
+  bp = 0;
+  for(;;){
+    if(blk == 0){
+      a = ip->addrs;
+      n = NIEXTENT;
+      link = &ip->addrs[NDIRECT+2];
+    } else {
+      bp = bread(ip->dev, blk);
+      a = (uint*)bp->data;
+      n = NBEXTENT;
+      link = &a[2*NBEXTENT];
+    }
+    for(; i < n && a[2*i+1] != 0; i++){
+      if(bn - lbn < a[2*i+1]){
+        addr = a[2*i] + (bn - lbn);
+        goto found;
+      }
+      lbn += a[2*i+1];
+    }
+    if(i < n || *link == 0)
+      break;
+    blk = *link;
+    if(bp)
+      brelse(bp);
+    i = 0;
+  }
+
+  // bn is past the end of the map.
+  if(bn != lbn)
+    panic("xmap: hole");
+  if(i > 0 && (addr = balloc_at(ip->dev, a[2*i-2] + a[2*i-1])) != 0){
+    i--;
+    lbn -= a[2*i+1];
+    a[2*i+1]++;
+  } else {
+    if(i > 0)
+      ip->goal = a[2*i-2] + a[2*i-1];
+    if(i == n){
+      // the inode or this extent block is full; chain another,
+      // ahead of the data block so that the new extent can
+      // grow in place.
+      blk = iballoc(ip);
+      *link = blk;
+      if(bp){
+        log_write(bp);
+        brelse(bp);
+      }
+      bp = bread(ip->dev, blk);
+      a = (uint*)bp->data;
+      i = 0;
+    }
+    addr = iballoc(ip);
+    a[2*i] = addr;
+    a[2*i+1] = 1;
+  }
+  if(bp)
+    log_write(bp);
+
+found:
+  ip->xlbn = lbn;
+  ip->xpbn = a[2*i];
+  ip->xlen = a[2*i+1];
+  ip->xblk = blk;
+  ip->xidx = i;
+  if(bp)
+    brelse(bp);
+  return addr;
+}
+
+// Read blocks bn up to end of extent inode ip into the cache
+// ahead of readi(), so that a contiguous run goes to the disk
+// as one request. Returns the block after the run.
+static uint
+xreadahead(struct inode *ip, uint bn, uint end)
+{
+  uint addr, n;
+
+  addr = xmap(ip, bn);
+  n = ip->xlbn + ip->xlen - bn;
+  if(n > end - bn)
+    n = end - bn;
+  if(n > NREADAHEAD)
+    n = NREADAHEAD;
+  if(n > 1)
+    bprefetch(ip->dev, addr, n);
+  return bn + n;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
+  uint addr, *a, n;
   struct buf *bp;
+  int level;
+
+  if(ip->flags & D_EXTENT)
+    return xmap(ip, bn);
+
+  // about to append to a file with no goal: aim for
+  // the block after its last one.
+  if(ip->goal == 0 && bn > 0 && bn*BSIZE >= ip->size)
+    ip->goal = bmap(ip, bn-1) + 1;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = iballoc(ip);
     return addr;
   }
   bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
+  // Find the tree that holds bn; n is the number
+  // of blocks it maps.
+  n = NINDIRECT;
+  for(level = 1; bn >= n; level++){
+    if(level == 3)
+      panic("bmap: out of range");
+    bn -= n;
+    n *= NINDIRECT;
+  }
+
+  if((addr = ip->addrs[NDIRECT+level-1]) == 0)
+    ip->addrs[NDIRECT+level-1] = addr = iballoc(ip);
+  while(level-- > 0){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+    n /= NINDIRECT;
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if((addr = a[bn / n]) == 0){
+      a[bn / n] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
-    return addr;
+    bn %= n;
   }
+  return addr;
+}
+
+// Free the blocks of an index tree level levels deep
+// rooted at block addr, and the root itself.
+static void
+itrunc_tree(uint dev, uint addr, int level)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
 
-  panic("bmap: out of range");
+  if(level > 0){
+    bp = bread(dev, addr);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j])
+        itrunc_tree(dev, a[j], level-1);
+    }
+    brelse(bp);
+  }
+  bfree(dev, addr);
+}
+
+// Free the blocks of extent inode ip, and its extent blocks.
+static void
+xtrunc(struct inode *ip)
+{
+  struct buf *bp;
+  uint blk, next, j, *a;
+  int i;
+
+  for(i = 0; i < NIEXTENT; i++)
+    for(j = 0; j < ip->addrs[2*i+1]; j++)
+      bfree(ip->dev, ip->addrs[2*i] + j);
+  for(blk = ip->addrs[NDIRECT+2]; blk; blk = next){
+    bp = bread(ip->dev, blk);
+    a = (uint*)bp->data;
+    for(i = 0; i < NBEXTENT; i++)
+      for(j = 0; j < a[2*i+1]; j++)
+        bfree(ip->dev, a[2*i] + j);
+    next = a[2*NBEXTENT];
+    brelse(bp);
+    bfree(ip->dev, blk);
+  }
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->xlen = 0;
 }
 
 // Truncate inode (discard contents).
@@ -409,9 +965,15 @@ bmap(struct inode *ip, uint bn)
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
+
+  pcdrop(ip->dev, ip->inum);
+  if(ip->flags & D_EXTENT){
+    xtrunc(ip);
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -420,22 +982,37 @@ itrunc(struct inode *ip)
     }
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  for(i = 0; i < 3; i++){
+    if(ip->addrs[NDIRECT+i]){
+      itrunc_tree(ip->dev, ip->addrs[NDIRECT+i], i+1);
+      ip->addrs[NDIRECT+i] = 0;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
   }
 
   ip->size = 0;
   iupdate(ip);
 }
 
+// Count the runs of contiguous blocks holding ip's data.
+// Caller must hold ip->lock.
+uint
+iruns(struct inode *ip)
+{
+  uint bn, nb, addr, prev, n;
+
+  if(ip->type != T_FILE && ip->type != T_DIR)
+    return 0;
+  nb = (ip->size + BSIZE - 1) / BSIZE;
+  n = prev = 0;
+  for(bn = 0; bn < nb; bn++){
+    addr = bmap(ip, bn);
+    if(bn == 0 || addr != prev + 1)
+      n++;
+    prev = addr;
+  }
+  return n;
+}
+
 // Copy stat information from inode.
 // Caller must hold ip->lock.
 void
@@ -448,6 +1025,40 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+#if BSIZE > PGSIZE || PGSIZE % BSIZE != 0
+#error "BSIZE must divide PGSIZE"
+#endif
+
+// Return page pgno of regular file ip from the page cache,
+// filling it from the file's blocks if it is not cached, or 0
+// if the cache has no free page. *ra and end are readi()'s
+// read-ahead state for extent files.
+// Caller must hold ip->lock.
+static struct page*
+ipage(struct inode *ip, uint pgno, uint *ra, uint end)
+{
+  struct page *pg;
+  struct buf *bp;
+  uint bn, off;
+
+  if((pg = pcget(ip->dev, ip->inum, pgno)) == 0 || pg->valid)
+    return pg;
+  for(off = 0; off < PGSIZE; off += BSIZE){
+    bn = (pgno*PGSIZE + off) / BSIZE;
+    if(bn*BSIZE >= ip->size){
+      memset(pg->data + off, 0, PGSIZE - off);
+      break;
+    }
+    if((ip->flags & D_EXTENT) && bn >= *ra && bn < end)
+      *ra = xreadahead(ip, bn, end);
+    bp = bread(ip->dev, bmap(ip, bn));
+    memmove(pg->data + off, bp->data, BSIZE);
+    brelse(bp);
+  }
+  pg->valid = 1;
+  return pg;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -455,15 +1066,29 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, ra, end;
   struct buf *bp;
+  struct page *pg;
+  int r;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
 
+  ra = 0;
+  end = (off + n + BSIZE - 1) / BSIZE;
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    if(ip->type == T_FILE && (pg = ipage(ip, off/PGSIZE, &ra, end)) != 0){
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      r = either_copyout(user_dst, dst, pg->data + (off % PGSIZE), m);
+      pcrelse(pg);
+      if(r == -1)
+        break;
+      continue;
+    }
+    if((ip->flags & D_EXTENT) && off/BSIZE >= ra)
+      ra = xreadahead(ip, off/BSIZE, end);
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
@@ -484,6 +1109,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  struct page *pg;
 
   if(off > ip->size || off + n < off)
     return -1;
@@ -498,6 +1124,10 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       break;
     }
     log_write(bp);
+    if(ip->type == T_FILE && (pg = pclookup(ip->dev, ip->inum, off/PGSIZE)) != 0){
+      memmove(pg->data + (off % PGSIZE), bp->data + (off % BSIZE), m);
+      pcrelse(pg);
+    }
     brelse(bp);
   }
 
@@ -521,18 +1151,268 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// A directory that outgrows DH_MIN entries switches to hashed
+// buckets (D_HASHED), found by extendible hashing on the name.
+// Each bucket is one block of dirents. Block 0 keeps "." and
+// "..", followed by a dirent holding the depth d of the table
+// and then the table itself, 2^d bucket block numbers packed
+// into the names of further dirents. Those all have inum 0, so
+// programs that read a directory as a plain list of dirents,
+// like ls and find, skip them. A full bucket is split in two,
+// doubling the table if needed, up to DH_MAXDEPTH.
+
+#define DH_MIN       128  // entries before a directory is hashed
+#if BSIZE >= 1024
+#define DH_MAXDEPTH  8
+#else
+#define DH_MAXDEPTH  7  // so the table fits in block 0, and the
+                        // buckets in the single-indirect range
+#endif
+#define DH_PER       (DIRSIZ / sizeof(ushort))  // table slots per dirent
+#define DH_TABDE     (((1 << DH_MAXDEPTH) + DH_PER - 1) / DH_PER)
+#define DH_SPLITS    2  // bucket splits one insertion may make
+
+// The splits must fit in the transaction of the op that adds
+// the name. The worst is a mkdir into a hashed directory dp
+// that splits twice: 10 blocks, which are the header block,
+// the old bucket and DH_SPLITS new ones, up to two bitmap
+// blocks, dp's inode block and the indirect block mapping its
+// new buckets, and the new inode's block and first data block.
+#if 1 + (1 << DH_MAXDEPTH) > NDIRECT + BSIZE/4
+#error "hashed directory buckets must not need a double-indirect block"
+#endif
+#if 2 + DH_SPLITS + 2 + 2 + 2 > MAXOPBLOCKS
+#error "a directory split may overrun MAXOPBLOCKS"
+#endif
+
+struct dirhead {
+  struct dirent dot, dotdot;
+  struct {
+    ushort inum;  // always 0
+    uchar depth;
+    char pad[DIRSIZ - 1];
+  } info;
+  struct {
+    ushort inum;  // always 0
+    ushort b[DH_PER];
+  } tab[DH_TABDE];
+};
+
+#define DH_EPB (BSIZE / sizeof(struct dirent))  // entries per bucket
+
+static uint
+dhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+static int
+isdots(char *name)
+{
+  return namecmp(name, ".") == 0 || namecmp(name, "..") == 0;
+}
+
+static uint
+dhget(struct dirhead *h, uint i)
+{
+  return h->tab[i / DH_PER].b[i % DH_PER];
+}
+
+static void
+dhset(struct dirhead *h, uint i, uint b)
+{
+  h->tab[i / DH_PER].b[i % DH_PER] = b;
+}
+
+// Return the block of hashed directory dp holding name's bucket.
+static uint
+dhbucket(struct inode *dp, char *name)
+{
+  uchar depth;
+  ushort b;
+  uint i;
+
+  if(readi(dp, 0, (uint64)&depth, 2*sizeof(struct dirent) + sizeof(ushort), 1) != 1)
+    panic("dhbucket");
+  i = dhash(name) & ((1 << depth) - 1);
+  if(readi(dp, 0, (uint64)&b, (3 + i / DH_PER) * sizeof(struct dirent) +
+           sizeof(ushort) * (1 + i % DH_PER), sizeof(b)) != sizeof(b))
+    panic("dhbucket");
+  return b;
+}
+
+// Append a zeroed block to directory dp; returns its number.
+static uint
+dirgrow(struct inode *dp)
+{
+  static char zeroes[BSIZE];
+  uint b;
+
+  b = dp->size / BSIZE;
+  if(writei(dp, 0, (uint64)zeroes, b * BSIZE, BSIZE) != BSIZE)
+    panic("dirgrow");
+  return b;
+}
+
+// Turn linear directory dp, whose slots are all in use, into
+// a hashed one with four buckets. Gives up, leaving dp as it
+// was, if the entries don't fit or don't spread well enough.
+static int
+dhconvert(struct inode *dp)
+{
+  struct dirent *des, de;
+  struct dirhead h;
+  int n, i, b, cnt[4];
+
+  n = dp->size / sizeof(de);
+  if(n * sizeof(de) > PGSIZE || (des = (struct dirent*)kalloc()) == 0)
+    return -1;
+  if(readi(dp, 0, (uint64)des, 0, dp->size) != dp->size)
+    panic("dhconvert read");
+  memset(cnt, 0, sizeof(cnt));
+  for(i = 2; i < n; i++)
+    cnt[dhash(des[i].name) & 3]++;
+  for(b = 0; b < 4; b++){
+    if(cnt[b] >= DH_EPB){
+      kfree((char*)des);
+      return -1;
+    }
+  }
+
+  memset(&h, 0, sizeof(h));
+  h.dot = des[0];
+  h.dotdot = des[1];
+  h.info.depth = 2;
+  for(b = 0; b < 4; b++)
+    dhset(&h, b, b + 1);
+  // rewrite block 0 as the header, and blocks 1-4 as buckets.
+  dp->size = 0;
+  dirgrow(dp);
+  if(writei(dp, 0, (uint64)&h, 0, sizeof(h)) != sizeof(h))
+    panic("dhconvert");
+  memset(cnt, 0, sizeof(cnt));
+  for(b = 0; b < 4; b++)
+    dirgrow(dp);
+  for(i = 2; i < n; i++){
+    b = dhash(des[i].name) & 3;
+    de = des[i];
+    if(writei(dp, 0, (uint64)&de, (b + 1) * BSIZE + cnt[b]++ * sizeof(de),
+              sizeof(de)) != sizeof(de))
+      panic("dhconvert");
+  }
+  kfree((char*)des);
+  dp->flags |= D_HASHED;
+  iupdate(dp);
+  return 0;
+}
+
+// Split bucket b of hashed directory dp, whose header is h, by
+// moving the entries whose hash has the next bit set to a new
+// bucket. Returns -1 if the table can't grow any further.
+static int
+dhsplit(struct inode *dp, struct dirhead *h, uint b)
+{
+  struct dirent de;
+  uint i, n, size, bit, nb, off, noff;
+
+  size = 1 << h->info.depth;
+  n = 0;
+  for(i = 0; i < size; i++)
+    if(dhget(h, i) == b)
+      n++;
+  if(n == 1){
+    // b is the only bucket for its hash values: double the table.
+    if(h->info.depth == DH_MAXDEPTH)
+      return -1;
+    for(i = 0; i < size; i++)
+      dhset(h, size + i, dhget(h, i));
+    h->info.depth++;
+    size *= 2;
+    n = 2;
+  }
+  // the n table slots for b agree in their low log2(size/n)
+  // bits; split on the next one.
+  bit = size / n;
+
+  nb = dirgrow(dp);
+  noff = nb * BSIZE;
+  for(off = b * BSIZE; off < (b + 1) * BSIZE; off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dhsplit read");
+    if(de.inum == 0 || (dhash(de.name) & bit) == 0)
+      continue;
+    if(writei(dp, 0, (uint64)&de, noff, sizeof(de)) != sizeof(de))
+      panic("dhsplit");
+    noff += sizeof(de);
+    memset(&de, 0, sizeof(de));
+    if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dhsplit");
+  }
+  for(i = 0; i < size; i++)
+    if(dhget(h, i) == b && (i & bit))
+      dhset(h, i, nb);
+  if(writei(dp, 0, (uint64)h, 0, sizeof(*h)) != sizeof(*h))
+    panic("dhsplit");
+  return 0;
+}
+
+// Find a free slot for name in hashed directory dp, splitting
+// its bucket if it is full. Returns the slot's offset, or -1.
+static int
+dhslot(struct inode *dp, char *name)
+{
+  struct dirhead h;
+  struct dirent de;
+  uint b, off;
+  int tries;
+
+  for(tries = 0; ; tries++){
+    b = dhbucket(dp, name);
+    for(off = b * BSIZE; off < (b + 1) * BSIZE; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dhslot read");
+      if(de.inum == 0)
+        return off;
+    }
+    // keep the blocks the splits write within what the
+    // caller's transaction allows; see DH_SPLITS.
+    if(tries == DH_SPLITS)
+      return -1;
+    if(readi(dp, 0, (uint64)&h, 0, sizeof(h)) != sizeof(h))
+      panic("dhslot read");
+    if(dhsplit(dp, &h, b) < 0)
+      return -1;
+  }
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, end, inum;
   struct dirent de;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  off = 0;
+  end = dp->size;
+  if(dp->flags & D_HASHED){
+    if(isdots(name)){
+      end = 2*sizeof(de);
+    } else {
+      off = dhbucket(dp, name) * BSIZE;
+      end = off + BSIZE;
+    }
+  }
+  for(; off < end; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
     if(de.inum == 0)
@@ -564,17 +1444,28 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if(dp->flags & D_HASHED){
+    if((off = dhslot(dp, name)) < 0)
+      return -1;
+  } else {
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
+    // a full, large directory: switch to hashing.
+    if(off >= dp->size && off >= DH_MIN * sizeof(de) && !isdots(name) &&
+       dhconvert(dp) == 0)
+      if((off = dhslot(dp, name)) < 0)
+        return -1;
   }
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcacheenter(dp->dev, dp->inum, name, inum);
 
   return 0;
 }
@@ -626,6 +1517,7 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  uint inum;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
@@ -643,7 +1535,13 @@ namex(char *path, int nameiparent, char *name)
       iunlock(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
+    if(dcachelookup(ip->dev, ip->inum, name, &inum)){
+      next = inum ? iget(ip->dev, inum) : 0;
+    } else {
+      next = dirlookup(ip, name, 0);
+      dcacheenter(ip->dev, ip->inum, name, next ? next->inum : 0);
+    }
+    if(next == 0){
       iunlockput(ip);
       return 0;
     }
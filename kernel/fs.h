@@ -4,7 +4,9 @@
 #include "types.h"
 
 #define ROOTINO  1   // root i-number
-#define BSIZE 1024  // block size
+#ifndef BSIZE
+#define BSIZE 1024  // block size; make BSIZE=4096 for 4 KB blocks
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -21,13 +23,16 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint bsize;        // Block size (bytes), must be BSIZE
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define NDIRECT 9
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -36,9 +41,21 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint flags;           // D_ flags
+  uint addrs[NDIRECT+3];   // Data block addresses
 };
 
+// An inode with D_EXTENT set maps its blocks with extents,
+// (start block, length) pairs covering the file in order.
+// The first NIEXTENT pairs are in addrs[], and addrs[NDIRECT+2]
+// links to a chain of extent blocks, each holding NBEXTENT
+// pairs followed by the link to the next. A zero length ends
+// the map.
+#define D_EXTENT 1
+#define D_HASHED 2  // directory with hashed buckets (see fs.c)
+#define NIEXTENT ((NDIRECT+2) / 2)
+#define NBEXTENT ((NINDIRECT-1) / 2)
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -21,6 +21,28 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// Commits are delayed: the last end_op() only commits if
+// the log could not take another system call. Otherwise the
+// transaction stays open in the buffer cache and keeps
+// absorbing writes, and the flusher kernel thread commits it
+// once it is COMMITAGE ticks old or DIRTYPCT% of the log is
+// in use. So a system call's updates are atomic as before,
+// but may reach the disk up to COMMITAGE ticks later.
+//
+// Transactions are double-buffered. A commit starts by
+// copying its blocks into the log area's buffers; once that
+// snapshot is taken, system calls may start again and build
+// up the next transaction in memory while the committing one
+// is written to the log. Only one transaction commits at a
+// time, so the on-disk log holds at most one.
+//
+// Installing a committed transaction to its home locations is
+// deferred: the flusher checkpoints it in the background while
+// the next transaction is being built, and a commit that finds
+// it still pending installs it before reusing the log. There
+// is no need to erase the header afterwards; replaying an
+// installed transaction during recovery is harmless.
+//
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -29,27 +51,50 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// The number of log blocks comes from the superblock (up to
+// LOGSIZE), and ops reserve log space according to how much
+// they may write, so a large write can go into one transaction.
+// The header carries a checksum over itself and the logged
+// blocks, which lets the header and the blocks be written as
+// one batch: if a crash tears the batch, recovery sees a bad
+// checksum and treats the log as empty.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
+  uint sum;
   int block[LOGSIZE];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // data blocks in the log
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks reserved by them.
   int committing;  // in commit(), please wait.
+  int copying;     // commit is taking its snapshot, please wait.
+  int flushing;    // a commit is wanted; hold off new ops.
+  uint opened;     // ticks when the transaction got its first block.
+  uint seq;        // number of the transaction being built.
+  uint synced;     // number of the last one on disk.
   int dev;
-  struct logheader lh;
+  struct logheader lh;  // the transaction being built
+  struct logheader ch;  // the transaction being committed
+  struct logheader ih;  // the committed one waiting to be installed
+  struct buf *lbuf[LOGSIZE+1]; // their header and snapshot, in log buffers
+  struct buf *dbuf[LOGSIZE];   // home blocks being installed
+  int defer[LOGSIZE];          // and ones that were busy
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void do_commit(void);
+static void checkpoint(void);
+static void flusher(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -59,145 +104,437 @@ initlog(int dev, struct superblock *sb)
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog - 1;
+  if(log.size > LOGSIZE)
+    log.size = LOGSIZE;
+  if(log.size < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
+  log.seq = 1;
   recover_from_log();
+
+  if(kproc("flusher", flusher) < 0)
+    panic("initlog: flusher");
 }
 
-// Copy committed blocks from log to their home location
+// Write home block b, locked, with the committed contents in
+// lbuf. If the cached b already carries changes of a later
+// transaction, the committed contents are swapped in for the
+// duration of the write, under the buffer's lock.
 static void
-install_trans(void)
+install_block(struct buf *b, struct buf *lbuf)
 {
-  int tail;
+  static uchar newer[BSIZE];
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  memmove(newer, b->data, BSIZE);
+  memmove(b->data, lbuf->data, BSIZE);
+  bwrite(b);
+  memmove(b->data, newer, BSIZE);
+}
+
+// Copy committed blocks from log to their home location.
+// On recovery the log blocks are read back from disk.
+// Otherwise the home blocks are still pinned in the cache,
+// and the snapshot is still in log.lbuf[1..]; the home
+// buffers are written from the cache as one batch sorted by
+// block number. Blocks that another process has locked, or
+// that already carry newer changes, are written one by one.
+static void
+install_trans(struct logheader *h, int recovering)
+{
+  struct buf **dbuf = log.dbuf;
+  struct buf *lbuf, *b;
+  int tail, i, n, nd;
+
+  n = nd = 0;
+  for (tail = 0; tail < h->n; tail++) {
+    if(recovering){
+      lbuf = bread(log.dev, log.start+tail+1); // read log block
+      b = bread(log.dev, h->block[tail]); // read dst
+      memmove(b->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    } else {
+      // don't wait for a lock while holding others.
+      if((b = btryread(log.dev, h->block[tail])) == 0){
+        log.defer[nd++] = tail;
+        continue;
+      }
+      lbuf = log.lbuf[tail+1];
+      if(memcmp(b->data, lbuf->data, BSIZE) != 0){
+        install_block(b, lbuf);
+        bunpin(b);
+        brelse(b);
+        continue;
+      }
+    }
+    for(i = n; i > 0 && dbuf[i-1]->blockno > b->blockno; i--)
+      dbuf[i] = dbuf[i-1];
+    dbuf[i] = b;
+    n++;
+  }
+  bwritev(dbuf, n);  // write dsts to disk
+  for (i = 0; i < n; i++) {
+    if(!recovering)
+      bunpin(dbuf[i]);
+    brelse(dbuf[i]);
   }
+  for (i = 0; i < nd; i++) {
+    tail = log.defer[i];
+    b = bread(log.dev, h->block[tail]);
+    lbuf = log.lbuf[tail+1];
+    if(memcmp(b->data, lbuf->data, BSIZE) == 0)
+      bwrite(b);
+    else
+      install_block(b, lbuf);
+    bunpin(b);
+    brelse(b);
+  }
+}
+
+// FNV-1a hash of n bytes at p, continuing from h.
+static uint
+cksum(uint h, void *p, int n)
+{
+  uchar *s = p;
+
+  while(n-- > 0)
+    h = (h ^ *s++) * 16777619;
+  return h;
+}
+
+// Checksum of a header's block count and block numbers;
+// the logged blocks' contents are folded in by the caller.
+static uint
+head_cksum(struct logheader *h)
+{
+  uint sum;
+
+  sum = cksum(2166136261, &h->n, sizeof(h->n));
+  return cksum(sum, h->block, h->n * sizeof(h->block[0]));
 }
 
 // Read the log header from disk into the in-memory log header
 static void
-read_head(void)
+read_head(struct logheader *h)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  h->n = lh->n;
+  if(h->n < 0 || h->n > log.size)
+    h->n = 0;
+  h->sum = lh->sum;
+  for (i = 0; i < h->n; i++) {
+    h->block[i] = lh->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Copy an in-memory log header into a header block buffer.
 static void
-write_head(void)
+fill_head(struct buf *buf, struct logheader *h)
 {
-  struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = h->n;
+  hb->sum = h->sum;
+  for (i = 0; i < h->n; i++) {
+    hb->block[i] = h->block[i];
   }
+}
+
+// Write an empty log header to disk.
+static void
+clear_head(void)
+{
+  struct buf *buf = bread(log.dev, log.start);
+  struct logheader h;
+
+  h.n = 0;
+  h.sum = head_cksum(&h);
+  fill_head(buf, &h);
   bwrite(buf);
   brelse(buf);
 }
 
+// Check the header read by read_head() against the
+// log blocks on disk; a mismatch means the commit
+// was torn by a crash and never happened.
+static int
+valid_log(struct logheader *h)
+{
+  uint sum;
+  int tail;
+
+  sum = head_cksum(h);
+  for (tail = 0; tail < h->n; tail++) {
+    struct buf *lbuf = bread(log.dev, log.start+tail+1);
+    sum = cksum(sum, lbuf->data, BSIZE);
+    brelse(lbuf);
+  }
+  return sum == h->sum;
+}
+
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  read_head(&log.ch);
+  if(!valid_log(&log.ch))
+    log.ch.n = 0;
+  install_trans(&log.ch, 1); // if committed, copy from log to disk
+  log.ch.n = 0;
+  clear_head(); // clear the log
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call that
+// may write up to n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  if(n > log.size)
+    panic("begin_opn: too big");
+
   acquire(&log.lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    if(log.copying || log.flushing){
       sleep(&log, &log.lock);
+    } else if(log.lh.n + log.reserved + n > log.size){
+      // this op might exhaust log space; commit what is
+      // there, or have the last outstanding op do it.
+      if(log.outstanding == 0){
+        do_commit();
+      } else {
+        log.flushing = 1;
+        sleep(&log, &log.lock);
+      }
     } else {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
 void
-end_op(void)
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// The most log blocks a single op may reserve; large
+// writes size their transactions to this.
+int
+log_opmax(void)
+{
+  int n = log.size / 2;
+
+  return n > MAXOPBLOCKS ? n : MAXOPBLOCKS;
+}
+
+// Commit the transaction being built. Called with log.lock
+// held and no FS system calls outstanding.
+static void
+do_commit(void)
 {
-  int do_commit = 0;
+  uint seq;
+
+  // wait for the previous commit to finish the on-disk log,
+  // keeping new ops out in the meantime.
+  while(log.committing){
+    log.flushing = 1;
+    sleep(&log, &log.lock);
+  }
+  if(log.outstanding > 0){
+    // ops got in while we slept (another commit cleared
+    // log.flushing); the last of them commits instead.
+    log.flushing = 1;
+    return;
+  }
+  log.flushing = 0;
+  if(log.lh.n == 0){
+    wakeup(&log);
+    return;
+  }
+
+  // hand the transaction over to commit() and start a new one.
+  seq = log.seq++;
+  log.committing = 1;
+  log.copying = 1;
+  log.ch = log.lh;
+  log.lh.n = 0;
+  release(&log.lock);
+
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks.
+  commit();
 
+  acquire(&log.lock);
+  log.committing = 0;
+  log.synced = seq;
+  wakeup(&log);
+}
+
+// Wait until every FS system call that has finished so far
+// is in the on-disk log, committing the open transaction
+// now rather than when the flusher gets to it.
+void
+log_sync(void)
+{
+  uint want;
+
+  acquire(&log.lock);
+  want = log.lh.n > 0 ? log.seq : log.seq - 1;
+  while((int)(log.synced - want) < 0){
+    if(log.seq == want){
+      // still being built: commit it, or have the
+      // last outstanding op do it.
+      if(log.outstanding == 0)
+        do_commit();
+      else
+        log.flushing = 1;
+    }
+    if((int)(log.synced - want) < 0)
+      sleep(&log, &log.lock);
+  }
+  release(&log.lock);
+}
+
+// called at the end of each FS system call.
+// commits if this was the last outstanding operation
+// and either the log is nearly full or the flusher asked.
+void
+end_opn(int n)
+{
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+  log.reserved -= n;
+  if(log.outstanding == 0 &&
+     (log.flushing || log.lh.n + MAXOPBLOCKS > log.size)){
+    do_commit();
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
+    // and decrementing log.reserved has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
   release(&log.lock);
+}
+
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// Kernel thread that installs committed transactions, and
+// writes back the open transaction in the background once it
+// has aged or once enough of the log is dirty. If FS system
+// calls are running, it stops new ones from starting and lets
+// the last end_op() do the commit.
+static void
+flusher(void)
+{
+  uint t;
+
+  for(;;){
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    t = ticks;
+    release(&tickslock);
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
     acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
+    if(log.ih.n > 0 && !log.committing){
+      // ops may go on building the next transaction meanwhile.
+      log.committing = 1;
+      release(&log.lock);
+      checkpoint();
+      acquire(&log.lock);
+      log.committing = 0;
+      wakeup(&log);
+    }
+    if(log.lh.n > 0 && !log.committing &&
+       (t - log.opened >= COMMITAGE || log.lh.n*100 >= log.size*DIRTYPCT)){
+      if(log.outstanding == 0)
+        do_commit();
+      else
+        log.flushing = 1;
+    }
     release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to log block buffers,
+// which stay locked in log.lbuf[1..] until the commit is done,
+// and fill in the header, with its checksum, in log.lbuf[0].
 static void
-write_log(void)
+copy_log(void)
 {
+  uint sum;
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
+  sum = head_cksum(&log.ch);
+  log.lbuf[0] = bread(log.dev, log.start); // header block
+  for (tail = 0; tail < log.ch.n; tail++) {
     struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
+    struct buf *from = bread(log.dev, log.ch.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    sum = cksum(sum, to->data, BSIZE);
+    log.lbuf[tail+1] = to;
     brelse(from);
-    brelse(to);
+  }
+  log.ch.sum = sum;
+  fill_head(log.lbuf[0], &log.ch);
+}
+
+// Write the header and the snapshot to the log.
+// This is the true point at which the transaction
+// commits. The checksum makes the order in which the
+// blocks reach the disk irrelevant, and the header and
+// log blocks are adjacent, so the whole batch goes to
+// the disk as one request.
+static void
+write_log(void)
+{
+  bwritev(log.lbuf, log.ch.n + 1);
+}
+
+// Install the committed transaction, if it has not been yet,
+// and let go of its snapshot. The caller has set log.committing.
+static void
+checkpoint(void)
+{
+  int tail;
+
+  if (log.ih.n > 0) {
+    install_trans(&log.ih, 0);
+    for (tail = 1; tail <= log.ih.n; tail++)
+      bunpin(log.lbuf[tail]);
+    log.ih.n = 0;
   }
 }
 
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  int tail;
+
+  if (log.ch.n > 0) {
+    checkpoint();    // The log is about to be reused
+    copy_log();      // Snapshot modified blocks
+    acquire(&log.lock);
+    log.copying = 0; // Let the next transaction start
+    wakeup(&log);
+    release(&log.lock);
+
+    write_log();     // Write header and snapshot -- the real commit
+    brelse(log.lbuf[0]);
+    for (tail = 1; tail <= log.ch.n; tail++) {
+      bpin(log.lbuf[tail]);  // Keep the snapshot for install
+      brelse(log.lbuf[tail]);
+    }
+    log.ih = log.ch;  // Install it later
+    log.ch.n = 0;
   }
 }
 
@@ -215,7 +552,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.size)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -228,8 +565,9 @@ log_write(struct buf *b)
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
+    if (log.lh.n == 0)
+      log.opened = ticks;
     log.lh.n++;
   }
   release(&log.lock);
 }
-
@@ -26,7 +26,11 @@ main()
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode cache
+    dcacheinit();    // directory entry cache
+    pcinit();        // file page cache
     fileinit();      // file table
+    pollinit();      // poll wait queues
+    shminit();       // shared-memory segments
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
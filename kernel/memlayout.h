@@ -62,6 +62,8 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   shared-memory segments (NSHMPROC slots of SHMMAXPG pages)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define SHMADDR(i) (TRAPFRAME - (NSHMPROC-(i))*SHMMAXPG*PGSIZE)
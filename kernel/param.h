@@ -2,12 +2,25 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE      200  // maximum number of cached i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NSHM         16  // shared-memory segments in the system
+#define NSHMPROC      4  // segments one process can attach
+#define SHMMAXPG     16  // max pages in a segment
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*12) // max data blocks in on-disk log
+#define NBUF         (LOGSIZE*3+MAXOPBLOCKS*4)  // size of disk block cache
+#define COMMITAGE    30  // ticks before the flusher commits a transaction
+#define DIRTYPCT     50  // % of log in use at which the flusher commits early
+#define NPCACHE     256  // pages in the file page cache
+#define NREADAHEAD   32  // max blocks read ahead in one disk request
+#define FSSIZE       20000 // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#ifndef DISKPOLL
+#define DISKPOLL      0  // spin for disk completions instead of sleeping
+#endif
+#ifndef FSLINEAR
+#define FSLINEAR      0  // scan inode blocks, bypass the dcache (baseline)
+#endif
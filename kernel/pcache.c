@@ -0,0 +1,174 @@
+// Page cache.
+//
+// Caches the contents of regular files a page at a time, keyed
+// by (device, i-number, page index within the file), so that
+// reading a cached part of a file needs neither bmap() nor the
+// buffer cache. Directories and other metadata are cached only
+// in the buffer cache.
+//
+// A page is filled and kept up to date by fs.c with the file's
+// inode locked: readi() fills a new page from the file's blocks,
+// writei() still writes blocks through the log and copies the
+// same bytes into a cached page, and itrunc() drops the file's
+// pages. So the inode's sleep-lock serializes use of its pages;
+// pcache.lock protects only the hash chains, the LRU list and
+// the reference counts, which keep a page in use from being
+// recycled for another file.
+//
+// Page memory is allocated with kalloc() the first time a page
+// is used. If every page is in use, or kalloc() fails, pcget()
+// returns 0 and the caller reads through the buffer cache.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "pcache.h"
+
+#define NPCHASH 67
+
+struct {
+  struct spinlock lock;
+  struct page page[NPCACHE];
+  struct page *hash[NPCHASH];
+
+  // Linked list of all pages, through prev/next, sorted by
+  // how recently the page was used, as in the buffer cache.
+  struct page head;
+} pcache;
+
+void
+pcinit(void)
+{
+  struct page *pg;
+
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(pg = pcache.page; pg < pcache.page+NPCACHE; pg++){
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+}
+
+static struct page**
+pchash(uint dev, uint inum, uint pgno)
+{
+  return &pcache.hash[(dev*31 + inum*17 + pgno) % NPCHASH];
+}
+
+// Remove pg from its hash chain.
+// Caller must hold pcache.lock.
+static void
+pcunhash(struct page *pg)
+{
+  struct page **pp;
+
+  for(pp = pchash(pg->dev, pg->inum, pg->pgno); *pp; pp = &(*pp)->hnext){
+    if(*pp == pg){
+      *pp = pg->hnext;
+      break;
+    }
+  }
+  pg->inum = 0;
+}
+
+// Find a cached page and take a reference to it.
+// Caller must hold pcache.lock.
+static struct page*
+pcfind(uint dev, uint inum, uint pgno)
+{
+  struct page *pg;
+
+  for(pg = *pchash(dev, inum, pgno); pg; pg = pg->hnext){
+    if(pg->dev == dev && pg->inum == inum && pg->pgno == pgno){
+      pg->ref++;
+      // move to the front of the LRU list.
+      pg->next->prev = pg->prev;
+      pg->prev->next = pg->next;
+      pg->next = pcache.head.next;
+      pg->prev = &pcache.head;
+      pcache.head.next->prev = pg;
+      pcache.head.next = pg;
+      return pg;
+    }
+  }
+  return 0;
+}
+
+// Return a referenced page for page pgno of file (dev, inum),
+// or 0 if no page is free. If the page is new, pg->valid is 0
+// and the caller must fill it and set valid.
+struct page*
+pcget(uint dev, uint inum, uint pgno)
+{
+  struct page *pg, **pp;
+
+  acquire(&pcache.lock);
+  if((pg = pcfind(dev, inum, pgno)) != 0){
+    release(&pcache.lock);
+    return pg;
+  }
+
+  // Not cached; recycle the least recently used unused page.
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+    if(pg->ref == 0){
+      if(pg->data == 0 && (pg->data = kalloc()) == 0)
+        break;
+      if(pg->inum)
+        pcunhash(pg);
+      pg->dev = dev;
+      pg->inum = inum;
+      pg->pgno = pgno;
+      pg->valid = 0;
+      pg->ref = 1;
+      pp = pchash(dev, inum, pgno);
+      pg->hnext = *pp;
+      *pp = pg;
+      release(&pcache.lock);
+      return pg;
+    }
+  }
+  release(&pcache.lock);
+  return 0;
+}
+
+// Return a referenced page for page pgno of file (dev, inum)
+// if it is cached, otherwise 0.
+struct page*
+pclookup(uint dev, uint inum, uint pgno)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  pg = pcfind(dev, inum, pgno);
+  release(&pcache.lock);
+  return pg;
+}
+
+// Release a reference to a page.
+void
+pcrelse(struct page *pg)
+{
+  acquire(&pcache.lock);
+  pg->ref--;
+  release(&pcache.lock);
+}
+
+// Drop every cached page of file (dev, inum).
+// Caller must hold the file's inode lock, so none is in use.
+void
+pcdrop(uint dev, uint inum)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < pcache.page+NPCACHE; pg++){
+    if(pg->dev == dev && pg->inum == inum)
+      pcunhash(pg);
+  }
+  release(&pcache.lock);
+}
@@ -0,0 +1,11 @@
+struct page {
+  uint dev;
+  uint inum;   // 0 if unused
+  uint pgno;   // page index within the file
+  int ref;
+  int valid;   // has data been read from the file?
+  char *data;  // PGSIZE bytes of file data
+  struct page *hnext;  // hash chain
+  struct page *prev;   // LRU list
+  struct page *next;
+};
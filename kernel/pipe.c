@@ -7,18 +7,48 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+#define PIPEMAXPG 16  // max pages in a pipe's ring
 
+// A pipe's bytes are held in a ring of size bytes: by default
+// the data[] that fills the rest of the pipe's page, or npg
+// separately allocated pages once F_SETPIPE_SZ asks for more.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  uint size;      // ring capacity in bytes
+  uint rpos;      // ring index of the next byte to read
+  int npg;        // pages in pg[], 0 if the ring is data[]
+  int rbusy;      // a splice is reading from the ring
+  int wbusy;      // a splice is writing a span it reserved
+  int rwait;      // readers sleeping on nread
+  int wwait;      // writers sleeping on nwrite
+  struct pollq pollq;
+  char *pg[PIPEMAXPG];
+  char data[];
 };
 
+#define PIPESIZE (PGSIZE - sizeof(struct pipe))  // default capacity
+
+// Return the address of the byte at ring index i of pi (mod
+// its size), and in *n how many bytes are contiguous from it.
+static char*
+ringp(struct pipe *pi, uint i, uint *n)
+{
+  i %= pi->size;
+  if(pi->npg == 0){
+    *n = pi->size - i;
+    return pi->data + i;
+  }
+  *n = PGSIZE - i % PGSIZE;
+  return pi->pg[i / PGSIZE] + i % PGSIZE;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -34,6 +64,14 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->size = PIPESIZE;
+  pi->rpos = 0;
+  pi->npg = 0;
+  pi->rbusy = 0;
+  pi->wbusy = 0;
+  pi->rwait = 0;
+  pi->wwait = 0;
+  pi->pollq.n = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -58,6 +96,8 @@ pipealloc(struct file **f0, struct file **f1)
 void
 pipeclose(struct pipe *pi, int writable)
 {
+  int i;
+
   acquire(&pi->lock);
   if(writable){
     pi->writeopen = 0;
@@ -66,62 +106,340 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwakeup(&pi->pollq);
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(i = 0; i < pi->npg; i++)
+      kfree(pi->pg[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Sleep on pi's nread or nwrite, counting the sleepers so
+// that the other side only calls wakeup() when someone waits.
+static void
+rsleep(struct pipe *pi)
+{
+  pi->rwait++;
+  sleep(&pi->nread, &pi->lock);
+  pi->rwait--;
+}
+
+static void
+wsleep(struct pipe *pi)
+{
+  pi->wwait++;
+  sleep(&pi->nwrite, &pi->lock);
+  pi->wwait--;
+}
+
+static void
+rwakeup(struct pipe *pi)
+{
+  if(pi->rwait)
+    wakeup(&pi->nread);
+  pollwakeup(&pi->pollq);
+}
+
+static void
+wwakeup(struct pipe *pi)
+{
+  if(pi->wwait)
+    wakeup(&pi->nwrite);
+  pollwakeup(&pi->pollq);
+}
+
+// Copy as much of the ring as is contiguous, free and wanted
+// with each copyin(), so a write costs one page-table walk per
+// run instead of one per byte.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user_src, uint64 addr, int n, int nonblock)
 {
   int i;
-  char ch;
+  char *p;
+  uint m, cnt;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+  i = 0;
+  while(i < n){
+    cnt = pi->nwrite - pi->nread;
+    if(cnt == pi->size || pi->wbusy){  //DOC: pipewrite-full
       if(pi->readopen == 0 || pr->killed){
         release(&pi->lock);
         return -1;
       }
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
+      if(nonblock)
+        break;
+      rwakeup(pi);
+      wsleep(pi);
+      continue;
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+    p = ringp(pi, pi->rpos + cnt, &m);
+    if(m > pi->size - cnt)
+      m = pi->size - cnt;
+    if(m > n - i)
+      m = n - i;
+    if(either_copyin(p, user_src, addr + i, m) == -1)
       break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    pi->nwrite += m;
+    i += m;
   }
-  wakeup(&pi->nread);
+  rwakeup(pi);
   release(&pi->lock);
+  if(i == 0 && n > 0 && nonblock)
+    return EWOULDBLOCK;
   return i;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int user_dst, uint64 addr, int n, int nonblock)
 {
   int i;
   struct proc *pr = myproc();
-  char ch;
+  char *p;
+  uint m;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rbusy){  //DOC: pipe-empty
     if(pr->killed){
       release(&pi->lock);
       return -1;
     }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    if(nonblock){
+      release(&pi->lock);
+      return EWOULDBLOCK;
+    }
+    rsleep(pi); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    p = ringp(pi, pi->rpos, &m);
+    if(m > pi->nwrite - pi->nread)
+      m = pi->nwrite - pi->nread;
+    if(m > n - i)
+      m = n - i;
+    if(either_copyout(user_dst, addr + i, p, m) == -1)
       break;
+    pi->rpos = (pi->rpos + m) % pi->size;
+    pi->nread += m;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  wwakeup(pi);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+// Splicing moves bytes between a pipe's ring and a file with
+// one copy: pipebeginread() hands out the ring's first run of
+// unread bytes, and pipebeginwrite() the first run of free
+// space, for the caller to copy from or into with the lock
+// released. The busy flags keep other readers, or writers,
+// off the ring until pipeendread() or pipeendwrite() says how
+// many bytes were used.
+//
+// Both return 0 and set *n to EWOULDBLOCK if wait is 0 and
+// nothing is ready or another splice holds the ring, or to -1
+// if the process was killed or, for a write, the pipe has no
+// reader. pipebeginread() sets *n to 0 at end of file.
+
+char*
+pipebeginread(struct pipe *pi, int wait, int *n)
+{
+  struct proc *pr = myproc();
+  char *p;
+  uint m;
+
+  acquire(&pi->lock);
+  while((pi->nread == pi->nwrite && pi->writeopen && wait) || pi->rbusy){
+    if(pr->killed){
+      release(&pi->lock);
+      *n = -1;
+      return 0;
+    }
+    if(!wait){
+      release(&pi->lock);
+      *n = EWOULDBLOCK;
+      return 0;
+    }
+    rsleep(pi);
+  }
+  if(pi->nread == pi->nwrite){
+    release(&pi->lock);
+    *n = pi->writeopen ? EWOULDBLOCK : 0;
+    return 0;
+  }
+  p = ringp(pi, pi->rpos, &m);
+  if(m > pi->nwrite - pi->nread)
+    m = pi->nwrite - pi->nread;
+  pi->rbusy = 1;
+  release(&pi->lock);
+  *n = m;
+  return p;
+}
+
+void
+pipeendread(struct pipe *pi, int n)
+{
+  acquire(&pi->lock);
+  pi->rpos = (pi->rpos + n) % pi->size;
+  pi->nread += n;
+  pi->rbusy = 0;
+  rwakeup(pi);
+  wwakeup(pi);
+  release(&pi->lock);
+}
+
+char*
+pipebeginwrite(struct pipe *pi, int wait, int *n)
+{
+  struct proc *pr = myproc();
+  char *p;
+  uint m, cnt;
+
+  acquire(&pi->lock);
+  while((pi->nwrite == pi->nread + pi->size && wait) || pi->wbusy){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      *n = -1;
+      return 0;
+    }
+    if(!wait){
+      release(&pi->lock);
+      *n = EWOULDBLOCK;
+      return 0;
+    }
+    rwakeup(pi);
+    wsleep(pi);
+  }
+  if(pi->readopen == 0){
+    release(&pi->lock);
+    *n = -1;
+    return 0;
+  }
+  cnt = pi->nwrite - pi->nread;
+  if(cnt == pi->size){
+    release(&pi->lock);
+    *n = EWOULDBLOCK;
+    return 0;
+  }
+  p = ringp(pi, pi->rpos + cnt, &m);
+  if(m > pi->size - cnt)
+    m = pi->size - cnt;
+  pi->wbusy = 1;
+  release(&pi->lock);
+  *n = m;
+  return p;
+}
+
+void
+pipeendwrite(struct pipe *pi, int n)
+{
+  acquire(&pi->lock);
+  pi->nwrite += n;
+  pi->wbusy = 0;
+  rwakeup(pi);
+  wwakeup(pi);
+  release(&pi->lock);
+}
+
+// Return the ready poll events of the read end of pi, or of
+// the write end if writable, after adding the caller to pi's
+// wait queue.
+int
+pipepoll(struct pipe *pi, int writable, int events, struct pollq **qp)
+{
+  int r = 0;
+
+  pollwait(&pi->pollq);
+  *qp = &pi->pollq;
+  acquire(&pi->lock);
+  if(writable){
+    if(pi->readopen == 0)
+      r = POLLHUP | POLLOUT;  // write fails at once
+    else if(pi->nwrite - pi->nread < pi->size && !pi->wbusy)
+      r = POLLOUT;
+  } else {
+    if(pi->nwrite != pi->nread && !pi->rbusy)
+      r = POLLIN;
+    if(pi->writeopen == 0)
+      r = POLLHUP | POLLIN;  // read returns 0 at once
+  }
+  release(&pi->lock);
+  return r & (events | POLLHUP);
+}
+
+// Return the capacity of pipe pi in bytes.
+int
+pipesize(struct pipe *pi)
+{
+  int n;
+
+  acquire(&pi->lock);
+  n = pi->size;
+  release(&pi->lock);
+  return n;
+}
+
+// Change the capacity of pipe pi to at least n bytes: the
+// default if that is enough, otherwise whole pages up to
+// PIPEMAXPG. Fails if the pipe holds more than would fit.
+// Returns the new capacity.
+int
+piperesize(struct pipe *pi, int n)
+{
+  char *pg[PIPEMAXPG], *src;
+  int npg, i, cnt;
+  uint size, m;
+
+  if(n <= 0)
+    return -1;
+  if(n <= PIPESIZE){
+    npg = 0;
+    size = PIPESIZE;
+  } else {
+    npg = (n + PGSIZE - 1) / PGSIZE;
+    if(npg > PIPEMAXPG)
+      return -1;
+    size = npg * PGSIZE;
+  }
+  for(i = 0; i < npg; i++){
+    if((pg[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(pg[i]);
+      return -1;
+    }
+  }
+
+  acquire(&pi->lock);
+  while(pi->rbusy || pi->wbusy){
+    if(pi->rbusy)
+      rsleep(pi);
+    else
+      wsleep(pi);
+  }
+  cnt = pi->nwrite - pi->nread;
+  if(size == pi->size || cnt > size){
+    release(&pi->lock);
+    for(i = 0; i < npg; i++)
+      kfree(pg[i]);
+    return size == pi->size ? size : -1;
+  }
+  // move the contents to the start of the new ring.
+  for(i = 0; i < cnt; i++){
+    src = ringp(pi, pi->rpos + i, &m);
+    if(npg)
+      pg[i / PGSIZE][i % PGSIZE] = *src;
+    else
+      pi->data[i] = *src;
+  }
+  for(i = 0; i < pi->npg; i++)
+    kfree(pi->pg[i]);
+  for(i = 0; i < npg; i++)
+    pi->pg[i] = pg[i];
+  pi->npg = npg;
+  pi->size = size;
+  pi->rpos = 0;
+  wwakeup(pi);
+  release(&pi->lock);
+  return size;
+}
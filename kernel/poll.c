@@ -0,0 +1,151 @@
+// Waiting for any of several files to become ready.
+//
+// Each pipe and pollable device has a wait queue (struct
+// pollq) of the processes polling it. poll() adds the caller
+// to the queue of each file before checking whether the file
+// is ready, and a change of state that might make a file ready
+// calls pollwakeup() on its queue, which marks those processes
+// woken and wakes them. p->pollwake, p->pollchan and the
+// queues are protected by polllock, which is taken after any
+// pipe or console lock.
+//
+// A process that finds a queue full, or that polls with a
+// timeout, sleeps on ticks instead, so it notices a change at
+// the next clock tick at the latest.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+
+struct spinlock polllock;
+
+void
+pollinit(void)
+{
+  initlock(&polllock, "poll");
+}
+
+// Add the calling process to wait queue q.
+void
+pollwait(struct pollq *q)
+{
+  struct proc *p = myproc();
+  int i;
+
+  acquire(&polllock);
+  for(i = 0; i < q->n; i++)
+    if(q->proc[i] == p)
+      break;
+  if(i == q->n){
+    if(q->n < NPOLLQ)
+      q->proc[q->n++] = p;
+    else
+      p->pollover = 1;
+  }
+  release(&polllock);
+}
+
+// Remove the calling process from wait queue q.
+static void
+pollunwait(struct pollq *q)
+{
+  struct proc *p = myproc();
+  int i;
+
+  acquire(&polllock);
+  for(i = 0; i < q->n; i++){
+    if(q->proc[i] == p){
+      q->proc[i] = q->proc[--q->n];
+      break;
+    }
+  }
+  release(&polllock);
+}
+
+// Wake the processes polling the object that owns q.
+void
+pollwakeup(struct pollq *q)
+{
+  struct proc *p;
+  int i;
+
+  if(q->n == 0)
+    return;
+  acquire(&polllock);
+  for(i = 0; i < q->n; i++){
+    p = q->proc[i];
+    p->pollwake = 1;
+    if(p->pollchan)
+      wakeup(p->pollchan);
+  }
+  release(&polllock);
+}
+
+// Wait until at least one of the n files in fds is ready for
+// the events asked of it, or until timeout ticks have passed
+// (never, if timeout is negative). Sets each revents and
+// returns the number of files with any set.
+int
+dopoll(struct pollfd *fds, int n, int timeout)
+{
+  struct proc *p = myproc();
+  struct pollq *q[NOFILE];
+  struct file *f;
+  int i, nready;
+  uint t0;
+
+  acquire(&tickslock);
+  t0 = ticks;
+  release(&tickslock);
+  acquire(&polllock);
+  p->pollover = 0;
+  release(&polllock);
+
+  for(i = 0; i < n; i++)
+    q[i] = 0;
+  for(;;){
+    acquire(&polllock);
+    p->pollwake = 0;
+    release(&polllock);
+
+    nready = 0;
+    for(i = 0; i < n; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if(fds[i].fd >= NOFILE || (f = p->ofile[fds[i].fd]) == 0)
+        fds[i].revents = POLLNVAL;
+      else
+        fds[i].revents = filepoll(f, fds[i].events, &q[i]);
+      if(fds[i].revents)
+        nready++;
+    }
+    if(nready > 0 || timeout == 0 || p->killed)
+      break;
+    acquire(&tickslock);
+    i = ticks - t0;
+    release(&tickslock);
+    if(timeout > 0 && i >= timeout)
+      break;
+
+    acquire(&polllock);
+    if(!p->pollwake){
+      p->pollchan = (timeout > 0 || p->pollover) ? (void*)&ticks : (void*)&p->pollwake;
+      sleep(p->pollchan, &polllock);
+      p->pollchan = 0;
+    }
+    release(&polllock);
+  }
+
+  for(i = 0; i < n; i++)
+    if(q[i])
+      pollunwait(q[i]);
+  return nready;
+}
@@ -0,0 +1,11 @@
+// A file descriptor and the events poll() should wait for.
+struct pollfd {
+  int fd;         // ignored if negative
+  short events;   // events of interest
+  short revents;  // events that are ready, set by poll()
+};
+
+#define POLLIN    0x001  // read will not block
+#define POLLOUT   0x004  // write will not block
+#define POLLHUP   0x010  // other end of the pipe is closed
+#define POLLNVAL  0x020  // fd is not open
@@ -16,6 +16,7 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kprocret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
 
@@ -139,8 +140,10 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->pagetable){
+    shmfree(p, p->pagetable);
     proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
   p->pid = 0;
@@ -149,6 +152,7 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kfn = 0;
   p->state = UNUSED;
 }
 
@@ -274,6 +278,11 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  if(shmfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   np->parent = p;
 
@@ -300,6 +309,31 @@ fork(void)
   return pid;
 }
 
+// Create a kernel thread that runs fn(), which must not return.
+// A kernel thread is scheduled like any process but never
+// enters user space, has no parent, and never exits.
+// Returns the new thread's pid, or -1.
+int
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc()) == 0)
+    return -1;
+
+  // start in kprocret instead of forkret.
+  p->context.ra = (uint64)kprocret;
+  p->kfn = fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  pid = p->pid;
+  p->state = RUNNABLE;
+  release(&p->lock);
+
+  return pid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -549,6 +583,20 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kprocret.
+static void
+kprocret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn();
+  panic("kproc returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -83,6 +83,8 @@ struct trapframe {
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
+struct shm;
+
 struct proc {
   struct spinlock lock;
 
@@ -94,6 +96,11 @@ struct proc {
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
 
+  // polllock must be held when using these:
+  int pollwake;                // A polled file changed state
+  int pollover;                // A polled file's wait queue was full
+  void *pollchan;              // Sleeping in poll() on pollchan
+
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
@@ -102,5 +109,7 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct shm *shm[NSHMPROC];   // Attached shared-memory segments
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Kernel thread body, if a kproc
 };
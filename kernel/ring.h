@@ -0,0 +1,42 @@
+// A submission and completion ring for ring_enter().
+//
+// The process fills in sq[sqtail % RINGSIZE] and advances
+// sqtail for each request. ring_enter() carries out requests
+// from sqhead up to sqtail, in order, advancing sqhead, and
+// posts a completion for each at cq[cqtail % RINGSIZE],
+// advancing cqtail. The process reaps completions from cqhead
+// without a system call, and advances cqhead past them;
+// ring_enter() stops early while the completion queue is full.
+
+#define RINGSIZE 32  // entries in each queue
+
+#define RING_NOP    0
+#define RING_READ   1  // read len bytes at off into addr
+#define RING_WRITE  2  // write len bytes from addr at off
+#define RING_OPEN   3  // open path addr with mode len; res is the fd
+#define RING_CLOSE  4
+#define RING_FSYNC  5  // wait until finished writes are on disk
+
+#define RING_CUROFF 0xffffffff  // off: use and advance the file offset
+
+struct ringsqe {
+  int op;
+  int fd;
+  uint64 addr;
+  int len;
+  uint off;
+  uint64 data;  // handed back in the completion
+};
+
+struct ringcqe {
+  uint64 data;
+  int res;      // what the system call would have returned
+  int pad;
+};
+
+struct ring {
+  uint sqhead, sqtail;
+  uint cqhead, cqtail;
+  struct ringsqe sq[RINGSIZE];
+  struct ringcqe cq[RINGSIZE];
+};
@@ -0,0 +1,193 @@
+// Shared-memory segments.
+//
+// A segment is a set of physical pages with a name, so that
+// unrelated processes can find it. shmcreate() and shmattach()
+// map its pages into the calling process with mappages(); a
+// process's attachment slot i is at SHMADDR(i), between the
+// heap and the trapframe. fork() gives the child the parent's
+// attachments, and exec() and exit() detach them. A segment is
+// freed, and its name forgotten, with its last attachment.
+//
+// shmtab.lock protects the segments' names and reference
+// counts; p->shm[] is private to the process.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define SHMNAME 16
+
+struct shm {
+  char name[SHMNAME];
+  int ref;            // attachments, 0 if the slot is free
+  int npg;
+  char *pg[SHMMAXPG];
+};
+
+struct {
+  struct spinlock lock;
+  struct shm seg[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Map segment s into page table pt at attachment slot i.
+static int
+shmmap(pagetable_t pt, int i, struct shm *s)
+{
+  int j;
+
+  for(j = 0; j < s->npg; j++){
+    if(mappages(pt, SHMADDR(i) + j*PGSIZE, PGSIZE, (uint64)s->pg[j],
+                PTE_R|PTE_W|PTE_U) < 0){
+      uvmunmap(pt, SHMADDR(i), j, 0);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Drop a reference to segment s, freeing it with the last.
+static void
+shmput(struct shm *s)
+{
+  int j;
+
+  acquire(&shmtab.lock);
+  if(--s->ref == 0){
+    for(j = 0; j < s->npg; j++)
+      kfree(s->pg[j]);
+    s->npg = 0;
+    s->name[0] = 0;
+  }
+  release(&shmtab.lock);
+}
+
+// Find the segment called name.
+// Caller must hold shmtab.lock.
+static struct shm*
+shmlookup(char *name)
+{
+  struct shm *s;
+
+  for(s = shmtab.seg; s < shmtab.seg + NSHM; s++)
+    if(s->ref > 0 && strncmp(s->name, name, SHMNAME) == 0)
+      return s;
+  return 0;
+}
+
+// Attach the segment called name to the calling process, first
+// creating it with size bytes of zeroes if create is set.
+// Returns the address it is attached at, or 0.
+uint64
+shmattach(char *name, int size, int create)
+{
+  struct proc *p = myproc();
+  struct shm *s;
+  int i, j;
+
+  for(i = 0; i < NSHMPROC && p->shm[i]; i++)
+    ;
+  if(i == NSHMPROC)
+    return 0;
+
+  acquire(&shmtab.lock);
+  s = shmlookup(name);
+  if(create){
+    if(s || size <= 0 || size > SHMMAXPG*PGSIZE)
+      goto bad;
+    for(s = shmtab.seg; s < shmtab.seg + NSHM && s->ref; s++)
+      ;
+    if(s == shmtab.seg + NSHM)
+      goto bad;
+    for(j = 0; j < PGROUNDUP(size) / PGSIZE; j++){
+      if((s->pg[j] = kalloc()) == 0){
+        while(--j >= 0)
+          kfree(s->pg[j]);
+        goto bad;
+      }
+      memset(s->pg[j], 0, PGSIZE);
+    }
+    s->npg = j;
+    safestrcpy(s->name, name, SHMNAME);
+  } else if(s == 0){
+    goto bad;
+  }
+  s->ref++;
+  release(&shmtab.lock);
+
+  if(shmmap(p->pagetable, i, s) < 0){
+    shmput(s);
+    return 0;
+  }
+  p->shm[i] = s;
+  return SHMADDR(i);
+
+ bad:
+  release(&shmtab.lock);
+  return 0;
+}
+
+// Detach the segment attached at va from the calling process.
+int
+shmdetach(uint64 va)
+{
+  struct proc *p = myproc();
+  int i;
+
+  for(i = 0; i < NSHMPROC; i++){
+    if(p->shm[i] && SHMADDR(i) == va){
+      uvmunmap(p->pagetable, va, p->shm[i]->npg, 0);
+      shmput(p->shm[i]);
+      p->shm[i] = 0;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Give child np the segments attached to p, at the same
+// addresses.
+int
+shmfork(struct proc *p, struct proc *np)
+{
+  int i;
+
+  for(i = 0; i < NSHMPROC; i++){
+    if(p->shm[i] == 0)
+      continue;
+    acquire(&shmtab.lock);
+    p->shm[i]->ref++;
+    release(&shmtab.lock);
+    if(shmmap(np->pagetable, i, p->shm[i]) < 0){
+      shmput(p->shm[i]);
+      return -1;
+    }
+    np->shm[i] = p->shm[i];
+  }
+  return 0;
+}
+
+// Detach all of p's segments from page table pt, which is p's
+// page table or, in exec(), the one it is replacing.
+void
+shmfree(struct proc *p, pagetable_t pt)
+{
+  int i;
+
+  for(i = 0; i < NSHMPROC; i++){
+    if(p->shm[i]){
+      uvmunmap(pt, SHMADDR(i), p->shm[i]->npg, 0);
+      shmput(p->shm[i]);
+      p->shm[i] = 0;
+    }
+  }
+}
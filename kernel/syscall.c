@@ -104,6 +104,20 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_copy_file_range(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_vmsplice(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_shmcreate(void);
+extern uint64 sys_shmattach(void);
+extern uint64 sys_shmdetach(void);
+extern uint64 sys_ring_enter(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +141,20 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_sendfile] sys_sendfile,
+[SYS_copy_file_range] sys_copy_file_range,
+[SYS_fcntl]   sys_fcntl,
+[SYS_splice]  sys_splice,
+[SYS_vmsplice] sys_vmsplice,
+[SYS_poll]    sys_poll,
+[SYS_shmcreate] sys_shmcreate,
+[SYS_shmattach] sys_shmattach,
+[SYS_shmdetach] sys_shmdetach,
+[SYS_ring_enter] sys_ring_enter,
 };
 
 void
@@ -20,3 +20,17 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_pread  22
+#define SYS_pwrite 23
+#define SYS_readv  24
+#define SYS_writev 25
+#define SYS_sendfile 26
+#define SYS_copy_file_range 27
+#define SYS_fcntl  28
+#define SYS_splice 29
+#define SYS_vmsplice 30
+#define SYS_poll   31
+#define SYS_shmcreate 32
+#define SYS_shmattach 33
+#define SYS_shmdetach 34
+#define SYS_ring_enter 35
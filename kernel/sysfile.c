@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "poll.h"
+#include "ring.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -91,6 +94,182 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the iovec array that is the nth system call argument,
+// with its length as argument n+1.
+static int
+argiov(int n, struct iovec *iov, int *cnt)
+{
+  uint64 uiov, tot;
+  int i;
+
+  if(argaddr(n, &uiov) < 0 || argint(n+1, cnt) < 0)
+    return -1;
+  if(*cnt < 0 || *cnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, *cnt * sizeof(*iov)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < *cnt; i++){
+    tot += iov[i].iov_len;
+    if(iov[i].iov_len > 0x7fffffff || tot > 0x7fffffff)
+      return -1;
+  }
+  return 0;
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  uint64 p;
+  uint uoff;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0 || n < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  uoff = off;
+  return filereadv(f, &iov, 1, &uoff);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  uint64 p;
+  uint uoff;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0 || n < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  uoff = off;
+  return filewritev(f, &iov, 1, &uoff);
+}
+
+// Fetch the offset that the nth system call argument points
+// to, if it is not 0, into *off and its address into *p.
+static int
+argoff(int n, uint64 *p, uint *off)
+{
+  if(argaddr(n, p) < 0)
+    return -1;
+  if(*p && copyin(myproc()->pagetable, (char*)off, *p, sizeof(*off)) < 0)
+    return -1;
+  return 0;
+}
+
+// Store the advanced offset back where argoff() found it.
+static int
+putoff(uint64 p, uint off)
+{
+  if(p && copyout(myproc()->pagetable, p, (char*)&off, sizeof(off)) < 0)
+    return -1;
+  return 0;
+}
+
+// Copy bytes from file in to file out without passing them
+// through user space: sendfile(out, in, offp, n) reads in at
+// *offp if offp is not 0, and copy_file_range(in, inoffp, out,
+// outoffp, n) can give either offset.
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  uint64 p;
+  uint off;
+  int n, r;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+     argoff(2, &p, &off) < 0 || argint(3, &n) < 0)
+    return -1;
+  r = filecopy(out, 0, in, p ? &off : 0, n);
+  if(r > 0 && putoff(p, off) < 0)
+    return -1;
+  return r;
+}
+
+uint64
+sys_copy_file_range(void)
+{
+  struct file *in, *out;
+  uint64 pin, pout;
+  uint inoff, outoff;
+  int n, r;
+
+  if(argfd(0, 0, &in) < 0 || argoff(1, &pin, &inoff) < 0 ||
+     argfd(2, 0, &out) < 0 || argoff(3, &pout, &outoff) < 0 ||
+     argint(4, &n) < 0)
+    return -1;
+  r = filecopy(out, pout ? &outoff : 0, in, pin ? &inoff : 0, n);
+  if(r > 0 && (putoff(pin, inoff) < 0 || putoff(pout, outoff) < 0))
+    return -1;
+  return r;
+}
+
+// Move bytes between a pipe and another file with one copy:
+// splice(in, inoffp, out, outoffp, n).
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  uint64 pin, pout;
+  uint inoff, outoff;
+  int n, r;
+
+  if(argfd(0, 0, &in) < 0 || argoff(1, &pin, &inoff) < 0 ||
+     argfd(2, 0, &out) < 0 || argoff(3, &pout, &outoff) < 0 ||
+     argint(4, &n) < 0)
+    return -1;
+  r = filesplice(out, pout ? &outoff : 0, in, pin ? &inoff : 0, n);
+  if(r > 0 && (putoff(pin, inoff) < 0 || putoff(pout, outoff) < 0))
+    return -1;
+  return r;
+}
+
+// Write user buffers into a pipe: vmsplice(fd, iov, cnt).
+uint64
+sys_vmsplice(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0 || f->type != FD_PIPE)
+    return -1;
+  return filewritev(f, iov, cnt, 0);
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  return filereadv(f, iov, cnt, 0);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  return filewritev(f, iov, cnt, 0);
+}
+
 uint64
 sys_close(void)
 {
@@ -218,6 +397,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheenter(dp->dev, dp->inum, name, 0);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -266,34 +446,44 @@ create(char *path, short type, short major, short minor)
   ip->minor = minor;
   ip->nlink = 1;
   iupdate(ip);
+  iplace(ip, dp);
 
   if(type == T_DIR){  // Create . and .. entries.
     dp->nlink++;  // for ".."
     iupdate(dp);
     // No ip->nlink++ for ".": avoid cyclic ref count.
     if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
-      panic("create dots");
+      goto fail;
   }
 
+  // a hashed directory may have no room for name.
   if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+    goto fail;
 
   iunlockput(dp);
 
   return ip;
+
+ fail:
+  // free ip, and undo the ".." link to dp.
+  ip->nlink = 0;
+  iupdate(ip);
+  if(type == T_DIR){
+    dp->nlink--;
+    iupdate(dp);
+  }
+  iunlockput(ip);
+  iunlockput(dp);
+  return 0;
 }
 
-uint64
-sys_open(void)
+// Open path with mode omode into a new descriptor.
+static int
+openpath(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -340,10 +530,19 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
   }
+  if((omode & O_EXTENT) && ip->type == T_FILE && ip->size == 0 &&
+     (ip->flags & D_EXTENT) == 0){
+    // switch the empty file to extents, dropping any
+    // blocks a failed write may have left behind.
+    itrunc(ip);
+    ip->flags |= D_EXTENT;
+    iupdate(ip);
+  }
 
   iunlock(ip);
   end_op();
@@ -351,6 +550,17 @@ sys_open(void)
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openpath(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -484,3 +694,128 @@ sys_pipe(void)
   }
   return 0;
 }
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  if(cmd == F_GETPIPE_SZ && f->type == FD_PIPE)
+    return pipesize(f->pipe);
+  if(cmd == F_SETPIPE_SZ && f->type == FD_PIPE)
+    return piperesize(f->pipe, arg);
+  if(cmd == F_GETFL)
+    return filegetfl(f);
+  if(cmd == F_SETFL)
+    return filesetfl(f, arg);
+  if(cmd == F_GETRUNS)
+    return fileruns(f);
+  return -1;
+}
+
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NOFILE];
+  uint64 ufds;
+  int n, timeout, r;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &ufds) < 0 || argint(1, &n) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(n < 0 || n > NOFILE)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, ufds, n * sizeof(fds[0])) < 0)
+    return -1;
+  r = dopoll(fds, n, timeout);
+  if(copyout(p->pagetable, ufds, (char*)fds, n * sizeof(fds[0])) < 0)
+    return -1;
+  return r;
+}
+
+// Carry out one ring request for the current process.
+static int
+ringop(struct ringsqe *e)
+{
+  struct file *f;
+  struct iovec iov;
+  char path[MAXPATH];
+  uint *offp;
+
+  switch(e->op){
+  case RING_NOP:
+    return 0;
+  case RING_OPEN:
+    if(fetchstr(e->addr, path, MAXPATH) < 0)
+      return -1;
+    return openpath(path, e->len);
+  case RING_FSYNC:
+    log_sync();
+    return 0;
+  }
+
+  if(e->fd < 0 || e->fd >= NOFILE || (f = myproc()->ofile[e->fd]) == 0)
+    return -1;
+  offp = e->off == RING_CUROFF ? 0 : &e->off;
+  switch(e->op){
+  case RING_READ:
+  case RING_WRITE:
+    if(e->len < 0)
+      return -1;
+    iov.iov_base = (void*)e->addr;
+    iov.iov_len = e->len;
+    if(e->op == RING_READ)
+      return filereadv(f, &iov, 1, offp);
+    return filewritev(f, &iov, 1, offp);
+  case RING_CLOSE:
+    myproc()->ofile[e->fd] = 0;
+    fileclose(f);
+    return 0;
+  }
+  return -1;
+}
+
+// Process the submitted requests of the ring at user address
+// r, one after another, posting their completions, so that a
+// batch of I/O costs one trap. Returns how many were done.
+uint64
+sys_ring_enter(void)
+{
+  struct proc *p = myproc();
+  struct ringsqe e;
+  struct ringcqe c;
+  uint64 r;
+  uint idx[4];  // sqhead, sqtail, cqhead, cqtail
+  int n;
+
+  if(argaddr(0, &r) < 0)
+    return -1;
+  if(copyin(p->pagetable, (char*)idx, r, sizeof(idx)) < 0)
+    return -1;
+
+  for(n = 0; idx[0] != idx[1] && idx[3] - idx[2] < RINGSIZE; n++){
+    if(copyin(p->pagetable, (char*)&e,
+              r + (uint64)&((struct ring*)0)->sq[idx[0] % RINGSIZE],
+              sizeof(e)) < 0)
+      break;
+    c.data = e.data;
+    c.res = ringop(&e);
+    c.pad = 0;
+    if(copyout(p->pagetable,
+               r + (uint64)&((struct ring*)0)->cq[idx[3] % RINGSIZE],
+               (char*)&c, sizeof(c)) < 0)
+      break;
+    idx[0]++;
+    idx[3]++;
+  }
+
+  if(copyout(p->pagetable, r + (uint64)&((struct ring*)0)->sqhead,
+             (char*)&idx[0], sizeof(idx[0])) < 0 ||
+     copyout(p->pagetable, r + (uint64)&((struct ring*)0)->cqtail,
+             (char*)&idx[3], sizeof(idx[3])) < 0)
+    return -1;
+  return n;
+}
@@ -95,3 +95,35 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// create and attach a shared-memory segment.
+uint64
+sys_shmcreate(void)
+{
+  char name[16];
+  int size;
+
+  if(argstr(0, name, sizeof(name)) < 0 || argint(1, &size) < 0)
+    return 0;
+  return shmattach(name, size, 1);
+}
+
+uint64
+sys_shmattach(void)
+{
+  char name[16];
+
+  if(argstr(0, name, sizeof(name)) < 0)
+    return 0;
+  return shmattach(name, 0, 0);
+}
+
+uint64
+sys_shmdetach(void)
+{
+  uint64 va;
+
+  if(argaddr(0, &va) < 0)
+    return -1;
+  return shmdetach(va);
+}
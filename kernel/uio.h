@@ -0,0 +1,7 @@
+// A buffer for the vectored I/O calls readv and writev.
+struct iovec {
+  void *iov_base;  // start address
+  uint64 iov_len;  // length in bytes
+};
+
+#define IOV_MAX 16  // max buffers in one readv or writev
@@ -45,7 +45,10 @@
 
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+#define NUM 32
+
+// at most this many data blocks in one disk request.
+#define MAXSEG 32
 
 struct VRingDesc {
   uint64 addr;
@@ -55,6 +58,7 @@ struct VRingDesc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr/len is a table of descriptors
 
 struct VRingUsedElem {
   uint32 id;   // index of start of completed descriptor chain
@@ -69,4 +73,24 @@ struct UsedArea {
   uint16 flags;
   uint16 id;
   struct VRingUsedElem elems[NUM];
+  uint16 avail_event; // VIRTIO_RING_F_EVENT_IDX only
+};
+
+// ring flags, for when VIRTIO_RING_F_EVENT_IDX is off.
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // driver: don't interrupt me
+#define VRING_USED_F_NO_NOTIFY     1 // device: don't notify me
+
+// with VIRTIO_RING_F_EVENT_IDX, the other side wants to hear
+// about it once its event index has been passed in moving
+// the ring index from old to new.
+#define VRING_NEED_EVENT(event, new, old) \
+  ((uint16)((new) - (event) - 1) < (uint16)((new) - (old)))
+
+// the format of the first descriptor in a disk request.
+// to be followed by descriptors for the data blocks,
+// and then one containing a 1-byte status.
+struct virtio_blk_req {
+  uint32 type; // VIRTIO_BLK_T_IN or ..._OUT
+  uint32 reserved;
+  uint64 sector;
 };
@@ -20,6 +20,12 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// I/O scheduler tuning, in clock ticks.
+// a queued request is dispatched out of elevator order
+// once it has waited this long.
+#define READ_EXPIRE  1
+#define WRITE_EXPIRE 5
+
 static struct disk {
  // memory for virtio descriptors &c for queue 0.
  // this is a global instead of allocated because it must
@@ -33,15 +39,32 @@ static struct disk {
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
   uint16 used_idx; // we've looked this far in used[2..NUM].
+  int inflight;    // requests handed to the device, not yet reaped.
+  int event_idx;   // negotiated VIRTIO_RING_F_EVENT_IDX?
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b; // first buf; merged ones hang off b->qnext
     char status;
   } info[NUM];
-  
+
+  // disk command headers.
+  // one-for-one with descriptors, for convenience.
+  struct virtio_blk_req ops[NUM];
+
+  // with VIRTIO_RING_F_INDIRECT_DESC, a request takes a single
+  // ring descriptor that points at its own table of descriptors.
+  // indexed by that ring descriptor.
+  int indirect;
+  struct VRingDesc itable[NUM][MAXSEG+2];
+
+  // requests waiting to be handed to the device,
+  // sorted by block number.
+  struct buf *queue;
+  uint headpos;    // block after the last dispatched request
+
   struct spinlock vdisk_lock;
   
 } __attribute__ ((aligned (PGSIZE))) disk;
@@ -73,9 +96,9 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.indirect = (features >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
+  disk.event_idx = (features >> VIRTIO_RING_F_EVENT_IDX) & 1;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -109,6 +132,13 @@ virtio_disk_init(void)
   for(int i = 0; i < NUM; i++)
     disk.free[i] = 1;
 
+  // in polled mode, waiters reap their own completions,
+  // so ask the device not to interrupt at all.
+  if(DISKPOLL){
+    disk.avail[0] = VRING_AVAIL_F_NO_INTERRUPT;
+    disk.avail[2 + NUM] = disk.used_idx - 1; // used_event
+  }
+
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
 
@@ -135,7 +165,6 @@ free_desc(int i)
     panic("virtio_disk_intr 2");
   disk.desc[i].addr = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -143,128 +172,354 @@ static void
 free_chain(int i)
 {
   while(1){
+    int flag = disk.desc[i].flags;
+    int nxt = disk.desc[i].next;
     free_desc(i);
-    if(disk.desc[i].flags & VRING_DESC_F_NEXT)
-      i = disk.desc[i].next;
+    if(flag & VRING_DESC_F_NEXT)
+      i = nxt;
     else
       break;
   }
 }
 
+// how many descriptors are free?
 static int
-alloc3_desc(int *idx)
+nfree_desc(void)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
-  return 0;
+  int n = 0;
+
+  for(int i = 0; i < NUM; i++)
+    if(disk.free[i])
+      n++;
+  return n;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// I/O scheduler.
+//
+// virtio_disk_rw() does not hand a request to the device
+// directly; it inserts the buf into disk.queue, sorted by
+// block number, and the dispatcher feeds the ring from there
+// whenever descriptors are free. Requests are taken in
+// ascending block order, sweeping from the last dispatched
+// block and wrapping around (C-SCAN), and runs of adjacent
+// blocks going in the same direction are merged into a single
+// multi-segment virtio request. Every request also carries a
+// deadline; once one has expired it is served first, so
+// a process cannot be starved by a stream of requests for
+// other parts of the disk.
+
+// can b be sent in the same request as a, right after it?
+static int
+elv_contiguous(struct buf *a, struct buf *b)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  return a->dev == b->dev && a->qwrite == b->qwrite &&
+    b->blockno == a->blockno + 1;
+}
 
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
+// add b to the queue. caller holds disk.vdisk_lock.
+static void
+elv_add(struct buf *b, int write)
+{
+  struct buf **pp;
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
+  b->qwrite = write;
+  b->deadline = ticks + (write ? WRITE_EXPIRE : READ_EXPIRE);
+  for(pp = &disk.queue; *pp; pp = &(*pp)->qnext)
+    if((*pp)->blockno > b->blockno)
       break;
+  b->qnext = *pp;
+  *pp = b;
+}
+
+// take the next request off the queue, merged with its
+// neighbours into at most maxseg blocks. returns the first
+// buf, with the rest linked through qnext, and sets *nseg.
+static struct buf*
+elv_dispatch(int maxseg, int *nseg)
+{
+  struct buf **pp, **pick, **run, *b, *prev, *last;
+  int n;
+
+  if(disk.queue == 0)
+    return 0;
+
+  // the oldest expired request, if any.
+  pick = 0;
+  for(pp = &disk.queue; *pp; pp = &(*pp)->qnext){
+    b = *pp;
+    if((int)(ticks - b->deadline) < 0)
+      continue;
+    if(pick == 0 || (int)(b->deadline - (*pick)->deadline) < 0)
+      pick = pp;
+  }
+
+  // otherwise, continue the sweep.
+  if(pick == 0){
+    for(pp = &disk.queue; *pp; pp = &(*pp)->qnext)
+      if((*pp)->blockno >= disk.headpos)
+        break;
+    pick = *pp ? pp : &disk.queue;
+  }
+
+  // back up to the start of the run of adjacent requests
+  // that the pick belongs to, keeping it within maxseg.
+  run = &disk.queue;
+  n = 0;
+  prev = 0;
+  for(pp = &disk.queue; ; pp = &(*pp)->qnext){
+    b = *pp;
+    if(prev == 0 || !elv_contiguous(prev, b)){
+      run = pp;
+      n = 1;
+    } else if(++n > maxseg){
+      run = &(*run)->qnext;
+      n--;
     }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+    if(pp == pick)
+      break;
+    prev = b;
   }
-  
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  // and extend forward.
+  last = *pick;
+  while(n < maxseg && last->qnext && elv_contiguous(last, last->qnext)){
+    last = last->qnext;
+    n++;
+  }
 
-  if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
-  else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  b = *run;
+  *run = last->qnext;
+  last->qnext = 0;
+  disk.headpos = last->blockno + 1;
+  *nseg = n;
+  return b;
+}
 
-  disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+// fill in descriptors for one request: a header, one
+// descriptor per block, and a 1-byte status. d[] holds the
+// nseg+2 descriptors and next[] the index that chains to each.
+static void
+fill_req(int head, struct VRingDesc **d, uint16 *next, struct buf *b)
+{
+  struct virtio_blk_req *buf0 = &disk.ops[head];
+  struct buf *bp;
+  int i;
+
+  buf0->type = b->qwrite ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  buf0->reserved = 0;
+  buf0->sector = b->blockno * (BSIZE / 512);
+
+  d[0]->addr = (uint64) buf0;
+  d[0]->len = sizeof(struct virtio_blk_req);
+  d[0]->flags = VRING_DESC_F_NEXT;
+  d[0]->next = next[0];
+
+  for(i = 1, bp = b; bp; i++, bp = bp->qnext){
+    d[i]->addr = (uint64) bp->data;
+    d[i]->len = BSIZE;
+    if(bp->qwrite)
+      d[i]->flags = 0; // device reads b->data
+    else
+      d[i]->flags = VRING_DESC_F_WRITE; // device writes b->data
+    d[i]->flags |= VRING_DESC_F_NEXT;
+    d[i]->next = next[i];
+  }
+
+  disk.info[head].status = 0xff; // device writes 0 on success
+  d[i]->addr = (uint64) &disk.info[head].status;
+  d[i]->len = 1;
+  d[i]->flags = VRING_DESC_F_WRITE; // device writes the status
+  d[i]->next = 0;
+}
+
+// hand one request of nseg blocks to the device. the caller
+// has checked that enough descriptors are free: one if the
+// device takes indirect tables, nseg+2 otherwise.
+static void
+virtio_disk_submit(struct buf *b, int nseg)
+{
+  struct VRingDesc *d[MAXSEG+2];
+  uint16 next[MAXSEG+2];
+  int head, i;
+
+  head = alloc_desc();
+  if(disk.indirect){
+    for(i = 0; i < nseg+2; i++){
+      d[i] = &disk.itable[head][i];
+      next[i] = i + 1;
+    }
+    fill_req(head, d, next, b);
+    disk.desc[head].addr = (uint64) disk.itable[head];
+    disk.desc[head].len = (nseg+2) * sizeof(struct VRingDesc);
+    disk.desc[head].flags = VRING_DESC_F_INDIRECT;
+    disk.desc[head].next = 0;
+  } else {
+    d[0] = &disk.desc[head];
+    for(i = 1; i < nseg+2; i++){
+      next[i-1] = alloc_desc();
+      d[i] = &disk.desc[next[i-1]];
+    }
+    fill_req(head, d, next, b);
+  }
 
   // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.info[head].b = b;
+  disk.inflight++;
 
   // avail[0] is flags
   // avail[1] tells the device how far to look in avail[2...].
   // avail[2...] are desc[] indices the device should process.
   // we only tell device the first index in our chain of descriptors.
-  disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
+  disk.avail[2 + (disk.avail[1] % NUM)] = head;
   __sync_synchronize();
   disk.avail[1] = disk.avail[1] + 1;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// move queued requests into the ring while there is room.
+// caller holds disk.vdisk_lock.
+static void
+virtio_disk_start(void)
+{
+  struct buf *b;
+  int nseg, room, kick;
+  uint16 old = disk.avail[1];
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  while(disk.queue){
+    if(disk.indirect)
+      room = nfree_desc() > 0 ? MAXSEG : 0;
+    else
+      room = nfree_desc() - 2;
+    if(room > MAXSEG)
+      room = MAXSEG;
+    if(room < 1)
+      break;
+    b = elv_dispatch(room, &nseg);
+    virtio_disk_submit(b, nseg);
   }
+  if(disk.avail[1] == old)
+    return;
+
+  // a notify is an exit to the device emulation;
+  // skip it if the device says it is still looking.
+  __sync_synchronize();
+  if(disk.event_idx)
+    kick = VRING_NEED_EVENT(disk.used->avail_event, disk.avail[1], old);
+  else
+    kick = (disk.used->flags & VRING_USED_F_NO_NOTIFY) == 0;
+  if(kick)
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// collect finished requests from the used ring, wake their
+// bufs, and start queued requests in the freed descriptors.
+// caller holds disk.vdisk_lock.
+static void
+virtio_disk_reap(void)
+{
+  struct buf *b, *next;
+  int n;
 
-  release(&disk.vdisk_lock);
+  while(1){
+    __sync_synchronize();
+    while(disk.used_idx != disk.used->id){
+      int id = disk.used->elems[disk.used_idx % NUM].id;
+
+      if(disk.info[id].status != 0)
+        panic("virtio_disk_intr status");
+
+      // disk is done with every buf in the request.
+      for(b = disk.info[id].b; b; b = next){
+        next = b->qnext;
+        b->qnext = 0;
+        b->disk = 0;
+        wakeup(b);
+      }
+      disk.info[id].b = 0;
+      free_chain(id);
+      disk.inflight--;
+
+      disk.used_idx += 1;
+    }
+
+    if(!disk.event_idx)
+      break;
+
+    // set used_event, the used index at which the device should
+    // interrupt next. rather than hearing about every request,
+    // let most of the ones in flight finish first; they all
+    // complete eventually, so the interrupt is never lost.
+    // polled mode never wants one.
+    if(DISKPOLL){
+      n = 0;
+    } else {
+      n = disk.inflight * 3 / 4;
+      if(n < 1)
+        n = 1;
+    }
+    disk.avail[2 + NUM] = disk.used_idx + n - 1;
+
+    // the device may have passed the new event index before
+    // it saw it; if so, there will be no interrupt for those.
+    __sync_synchronize();
+    if(disk.used_idx == disk.used->id)
+      break;
+  }
+
+  virtio_disk_start();
 }
 
+// read or write n locked bufs. they are queued together,
+// so adjacent blocks go to the device as one request.
 void
-virtio_disk_intr()
+virtio_disk_rwv(struct buf **bs, int n, int write)
 {
+  int i;
+
   acquire(&disk.vdisk_lock);
 
-  while((disk.used_idx % NUM) != (disk.used->id % NUM)){
-    int id = disk.used->elems[disk.used_idx].id;
+  for(i = 0; i < n; i++){
+    bs[i]->disk = 1;
+    elv_add(bs[i], write);
+  }
+  virtio_disk_start();
+
+  // Wait for the requests to finish: either spin on the
+  // used ring, or sleep until virtio_disk_intr() says so.
+  for(i = 0; i < n; i++){
+    while(bs[i]->disk == 1) {
+      if(DISKPOLL){
+        virtio_disk_reap();
+        if(bs[i]->disk == 1){
+          // let interrupts and other CPUs in.
+          release(&disk.vdisk_lock);
+          acquire(&disk.vdisk_lock);
+        }
+      } else {
+        sleep(bs[i], &disk.vdisk_lock);
+      }
+    }
+  }
 
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
-    
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+  release(&disk.vdisk_lock);
+}
 
-    disk.used_idx = (disk.used_idx + 1) % NUM;
-  }
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_rwv(&b, 1, write);
+}
+
+void
+virtio_disk_intr()
+{
+  acquire(&disk.vdisk_lock);
+
+  // the device updates the used ring before interrupting,
+  // so ack first; anything that arrives later raises
+  // another interrupt.
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
+  virtio_disk_reap();
+
   release(&disk.vdisk_lock);
 }
@@ -0,0 +1,91 @@
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Block allocation rate and fragmentation.
+// usage: allocbench [nproc [nblocks]]
+// Each writer appends nblocks blocks, one write at a time, to a
+// file in its own directory, so the allocator sees interleaved
+// requests. Reports blocks allocated per 100 ticks and the
+// average length of the files' contiguous runs.
+
+char buf[1024];
+
+void dirname(char *dir, int i) {
+  dir[0] = 'a';
+  dir[1] = 'b';
+  dir[2] = '0' + i / 10 % 10;
+  dir[3] = '0' + i % 10;
+  dir[4] = 0;
+}
+
+void filename(char *path, int i) {
+  dirname(path, i);
+  path[4] = '/';
+  path[5] = 'f';
+  path[6] = 0;
+}
+
+int main(int argc, char *argv[]) {
+  int nproc = argc > 1 ? atoi(argv[1]) : 4;
+  int nblocks = argc > 2 ? atoi(argv[2]) : 256;
+  char path[16];
+  int i, j, fd, t0, t1, n, runs;
+
+  for (i = 0; i < nproc; i++) {
+    dirname(path, i);
+    if (mkdir(path) < 0) {
+      printf("allocbench: mkdir %s failed\n", path);
+      exit(1);
+    }
+  }
+
+  t0 = uptime();
+  for (i = 0; i < nproc; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf("allocbench: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0) {
+      filename(path, i);
+      if ((fd = open(path, O_CREATE | O_WRONLY)) < 0) {
+        printf("allocbench: create %s failed\n", path);
+        exit(1);
+      }
+      for (j = 0; j < nblocks; j++) {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+          printf("allocbench: write failed\n");
+          exit(1);
+        }
+      }
+      close(fd);
+      exit(0);
+    }
+  }
+  for (i = 0; i < nproc; i++) wait(0);
+  t1 = uptime();
+
+  runs = 0;
+  for (i = 0; i < nproc; i++) {
+    filename(path, i);
+    if ((fd = open(path, O_RDONLY)) < 0 || (n = fcntl(fd, F_GETRUNS, 0)) < 0) {
+      printf("allocbench: counting runs of %s failed\n", path);
+      exit(1);
+    }
+    close(fd);
+    runs += n;
+    unlink(path);
+    dirname(path, i);
+    unlink(path);
+  }
+
+  printf("allocbench: %d writers x %d blocks: %d ticks, %d runs\n", nproc,
+         nblocks, t1 - t0, runs);
+  if (t1 > t0)
+    printf("allocbench: %d blocks per 100 ticks\n",
+           nproc * nblocks * 100 / (t1 - t0));
+  if (runs > 0)
+    printf("allocbench: %d blocks per run\n", nproc * nblocks / runs);
+  exit(0);
+}
@@ -0,0 +1,78 @@
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Large-file sequential write and read throughput.
+// usage: bigbench [-x] [kbytes [chunk-kbytes]]
+// Writes a file of the given size in chunks, reads it back,
+// checks the contents, and removes it. With -x the file is
+// mapped with extents.
+
+#define MAXCHUNK 64
+
+char buf[MAXCHUNK * 1024];
+
+void fill(int chunk, int n) {
+  for (int i = 0; i < n; i += sizeof(int)) *(int *)(buf + i) = chunk + i;
+}
+
+int check(int chunk, int n) {
+  for (int i = 0; i < n; i += sizeof(int))
+    if (*(int *)(buf + i) != chunk + i) return 0;
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  int extent = argc > 1 && strcmp(argv[1], "-x") == 0;
+  if (extent) {
+    argc--;
+    argv++;
+  }
+  int kb = argc > 1 ? atoi(argv[1]) : 4096;
+  int ckb = argc > 2 ? atoi(argv[2]) : 16;
+  int fd, i, n, nchunk, t0, t1, t2;
+
+  if (ckb < 1 || ckb > MAXCHUNK) {
+    printf("bigbench: chunk must be 1..%d KB\n", MAXCHUNK);
+    exit(1);
+  }
+  n = ckb * 1024;
+  nchunk = kb / ckb;
+
+  if ((fd = open("bigbench.tmp",
+                 O_CREATE | O_TRUNC | O_WRONLY | (extent ? O_EXTENT : 0))) < 0) {
+    printf("bigbench: create failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  for (i = 0; i < nchunk; i++) {
+    fill(i, n);
+    if (write(fd, buf, n) != n) {
+      printf("bigbench: write failed at chunk %d\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+  t1 = uptime();
+
+  if ((fd = open("bigbench.tmp", O_RDONLY)) < 0) {
+    printf("bigbench: open failed\n");
+    exit(1);
+  }
+  for (i = 0; i < nchunk; i++) {
+    if (read(fd, buf, n) != n || !check(i, n)) {
+      printf("bigbench: bad read at chunk %d\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+  t2 = uptime();
+  unlink("bigbench.tmp");
+
+  printf("bigbench: %d KB in %d KB chunks%s: write %d ticks, read %d ticks\n",
+         nchunk * ckb, ckb, extent ? " (extents)" : "", t1 - t0, t2 - t1);
+  if (t1 > t0 && t2 > t1)
+    printf("bigbench: write %d KB, read %d KB per 100 ticks\n",
+           nchunk * ckb * 100 / (t1 - t0), nchunk * ckb * 100 / (t2 - t1));
+  exit(0);
+}
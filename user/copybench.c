@@ -0,0 +1,71 @@
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+// File copy throughput: a read/write loop through a user
+// buffer, as cat does, against copy_file_range.
+// usage: copybench [kbytes]
+
+char buf[4096];
+
+int copyloop(int in, int out) {
+  int n, tot = 0;
+
+  while ((n = read(in, buf, sizeof(buf))) > 0) {
+    if (write(out, buf, n) != n) return -1;
+    tot += n;
+  }
+  return tot;
+}
+
+int copyrange(int in, int out) {
+  int n, tot = 0;
+
+  while ((n = copy_file_range(in, 0, out, 0, 64 * 1024)) > 0) tot += n;
+  return n < 0 ? -1 : tot;
+}
+
+int run(char *name, int (*copy)(int, int), int size) {
+  int in, out, n, t0;
+
+  if ((in = open("copybench.in", O_RDONLY)) < 0 ||
+      (out = open("copybench.out", O_CREATE | O_TRUNC | O_WRONLY)) < 0) {
+    printf("copybench: open failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  n = copy(in, out);
+  t0 = uptime() - t0;
+  close(in);
+  close(out);
+  unlink("copybench.out");
+  if (n != size) {
+    printf("copybench: %s copied %d of %d bytes\n", name, n, size);
+    exit(1);
+  }
+  printf("copybench: %s: %d KB in %d ticks\n", name, size / 1024, t0);
+  return t0;
+}
+
+int main(int argc, char *argv[]) {
+  int kb = argc > 1 ? atoi(argv[1]) : 2048;
+  int fd, i;
+
+  if ((fd = open("copybench.in", O_CREATE | O_TRUNC | O_WRONLY)) < 0) {
+    printf("copybench: create failed\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for (i = 0; i < kb / 4; i++) {
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      printf("copybench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  run("read/write", copyloop, kb / 4 * 4096);
+  run("copy_file_range", copyrange, kb / 4 * 4096);
+  unlink("copybench.in");
+  exit(0);
+}
@@ -0,0 +1,79 @@
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+// File-create throughput with several writer processes.
+// usage: createbench [nproc [nfiles]]
+// Each writer creates, writes and closes nfiles small files
+// in its own directory; the files are removed afterwards.
+
+void dirname(char *dir, int i) {
+  dir[0] = 'c';
+  dir[1] = 'b';
+  dir[2] = '0' + i / 10 % 10;
+  dir[3] = '0' + i % 10;
+  dir[4] = 0;
+}
+
+void filename(char *path, int i, int j) {
+  dirname(path, i);
+  path[4] = '/';
+  path[5] = 'f';
+  path[6] = '0' + j / 100 % 10;
+  path[7] = '0' + j / 10 % 10;
+  path[8] = '0' + j % 10;
+  path[9] = 0;
+}
+
+int main(int argc, char *argv[]) {
+  int nproc = argc > 1 ? atoi(argv[1]) : 4;
+  int nfiles = argc > 2 ? atoi(argv[2]) : 40;
+  char path[16], data[64];
+  int i, j, fd, t0, t1, t2;
+
+  memset(data, 'x', sizeof(data));
+  t0 = uptime();
+  for (i = 0; i < nproc; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf("createbench: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0) {
+      dirname(path, i);
+      if (mkdir(path) < 0) {
+        printf("createbench: mkdir %s failed\n", path);
+        exit(1);
+      }
+      for (j = 0; j < nfiles; j++) {
+        filename(path, i, j);
+        if ((fd = open(path, O_CREATE | O_WRONLY)) < 0) {
+          printf("createbench: create %s failed\n", path);
+          exit(1);
+        }
+        write(fd, data, sizeof(data));
+        close(fd);
+      }
+      exit(0);
+    }
+  }
+  for (i = 0; i < nproc; i++) wait(0);
+  t1 = uptime();
+
+  for (i = 0; i < nproc; i++) {
+    for (j = 0; j < nfiles; j++) {
+      filename(path, i, j);
+      unlink(path);
+    }
+    dirname(path, i);
+    unlink(path);
+  }
+  t2 = uptime();
+
+  printf("createbench: %d writers x %d files: create %d ticks, unlink %d ticks\n",
+         nproc, nfiles, t1 - t0, t2 - t1);
+  if (t1 > t0)
+    printf("createbench: %d files per 100 ticks\n",
+           nproc * nfiles * 100 / (t1 - t0));
+  exit(0);
+}
@@ -0,0 +1,78 @@
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Creation cost as the inode table fills up.
+// usage: manybench [nfiles [batch]]
+// Creates nfiles empty files, batch of them per directory, and
+// prints the ticks each batch took; with a linear inode scan
+// the later batches get slower. The files are removed after.
+// For the baseline, run it on a kernel built with
+// "make FSLINEAR=1", which finds free inodes by reading the
+// inode blocks in order and does not use the dcache.
+
+void dirname(char *dir, int i) {
+  dir[0] = 'm';
+  dir[1] = 'b';
+  dir[2] = '0' + i / 100 % 10;
+  dir[3] = '0' + i / 10 % 10;
+  dir[4] = '0' + i % 10;
+  dir[5] = 0;
+}
+
+void filename(char *path, int i, int j) {
+  dirname(path, i);
+  path[5] = '/';
+  path[6] = 'f';
+  path[7] = '0' + j / 100 % 10;
+  path[8] = '0' + j / 10 % 10;
+  path[9] = '0' + j % 10;
+  path[10] = 0;
+}
+
+int main(int argc, char *argv[]) {
+  int nfiles = argc > 1 ? atoi(argv[1]) : 1500;
+  int batch = argc > 2 ? atoi(argv[2]) : 100;
+  int ndirs, i, j, fd, t0, t1, first, last;
+  char path[16];
+
+  if (batch < 1 || batch > 999) {
+    printf("manybench: batch must be 1..999\n");
+    exit(1);
+  }
+  ndirs = nfiles / batch;
+  first = last = 0;
+  for (i = 0; i < ndirs; i++) {
+    t0 = uptime();
+    dirname(path, i);
+    if (mkdir(path) < 0) {
+      printf("manybench: mkdir %s failed\n", path);
+      break;
+    }
+    for (j = 0; j < batch; j++) {
+      filename(path, i, j);
+      if ((fd = open(path, O_CREATE | O_WRONLY)) < 0) {
+        printf("manybench: create %s failed\n", path);
+        exit(1);
+      }
+      close(fd);
+    }
+    t1 = uptime();
+    printf("manybench: files %d-%d: %d ticks\n", i * batch,
+           (i + 1) * batch - 1, t1 - t0);
+    if (i == 0) first = t1 - t0;
+    last = t1 - t0;
+  }
+
+  for (i = 0; i < ndirs; i++) {
+    for (j = 0; j < batch; j++) {
+      filename(path, i, j);
+      unlink(path);
+    }
+    dirname(path, i);
+    unlink(path);
+  }
+  printf("manybench: first batch %d ticks, last batch %d ticks\n", first,
+         last);
+  exit(0);
+}
@@ -0,0 +1,67 @@
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Pipe throughput between two processes.
+// usage: pipebench [kbytes [chunk-bytes [pipe-bytes]]]
+// The child writes kbytes through the pipe in chunk-byte
+// writes while the parent reads; pipe-bytes, if given, sets
+// the pipe's capacity with F_SETPIPE_SZ first.
+
+#define MAXCHUNK 16384
+
+char buf[MAXCHUNK];
+
+int main(int argc, char *argv[]) {
+  int kb = argc > 1 ? atoi(argv[1]) : 8192;
+  int chunk = argc > 2 ? atoi(argv[2]) : 4096;
+  int fds[2], pid, n, size, t0, t1;
+  long total, want;
+
+  if (chunk < 1 || chunk > MAXCHUNK) {
+    printf("pipebench: chunk must be 1..%d bytes\n", MAXCHUNK);
+    exit(1);
+  }
+  if (pipe(fds) < 0) {
+    printf("pipebench: pipe failed\n");
+    exit(1);
+  }
+  if (argc > 3 && fcntl(fds[1], F_SETPIPE_SZ, atoi(argv[3])) < 0) {
+    printf("pipebench: cannot set pipe size %s\n", argv[3]);
+    exit(1);
+  }
+  size = fcntl(fds[0], F_GETPIPE_SZ, 0);
+  want = (long)kb * 1024;
+
+  t0 = uptime();
+  if ((pid = fork()) < 0) {
+    printf("pipebench: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    memset(buf, 'p', chunk);
+    for (total = 0; total < want; total += n) {
+      n = want - total < chunk ? want - total : chunk;
+      if (write(fds[1], buf, n) != n) {
+        printf("pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  total = 0;
+  while ((n = read(fds[0], buf, MAXCHUNK)) > 0) total += n;
+  wait(0);
+  t1 = uptime();
+
+  if (total != want) {
+    printf("pipebench: read %d of %d bytes\n", (int)total, (int)want);
+    exit(1);
+  }
+  printf("pipebench: %d KB in %d-byte writes through a %d-byte pipe: %d ticks\n",
+         kb, chunk, size, t1 - t0);
+  if (t1 > t0) printf("pipebench: %d KB per 100 ticks\n", kb * 100 / (t1 - t0));
+  exit(0);
+}
@@ -0,0 +1,134 @@
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+// Small-file I/O throughput: open, write or read, and close
+// each file with one system call per step, against batching
+// the steps through ring_enter.
+// usage: ringbench [nfiles]
+
+#define FILESZ 512
+// Files per batch. Each batch holds its files open at once, so
+// it must fit in the NOFILE (16) descriptors less stdin, stdout
+// and stderr; its writes and closes, two entries per file, must
+// fit in the ring.
+#define BATCH 8
+
+char buf[FILESZ];
+char names[BATCH][8];
+struct ring r;
+
+void name(char *s, int i) {
+  s[0] = 'r';
+  s[1] = 'b';
+  s[2] = '0' + i / 1000 % 10;
+  s[3] = '0' + i / 100 % 10;
+  s[4] = '0' + i / 10 % 10;
+  s[5] = '0' + i % 10;
+  s[6] = 0;
+}
+
+void push(int op, int fd, void *addr, int len) {
+  struct ringsqe *e = &r.sq[r.sqtail % RINGSIZE];
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->len = len;
+  e->off = RING_CUROFF;
+  e->data = r.sqtail;
+  r.sqtail++;
+}
+
+// Submit everything queued and return the results in order.
+void submit(int *res) {
+  int i = 0;
+
+  while (r.sqhead != r.sqtail) {
+    if (ring_enter(&r) < 0) {
+      printf("ringbench: ring_enter failed\n");
+      exit(1);
+    }
+    while (r.cqhead != r.cqtail) res[i++] = r.cq[r.cqhead++ % RINGSIZE].res;
+  }
+}
+
+int syscalls(int nfiles, int writing) {
+  char s[8];
+  int i, fd, n;
+
+  for (i = 0; i < nfiles; i++) {
+    name(s, i);
+    if ((fd = open(s, writing ? O_CREATE | O_TRUNC | O_WRONLY : O_RDONLY)) < 0)
+      return -1;
+    n = writing ? write(fd, buf, FILESZ) : read(fd, buf, FILESZ);
+    close(fd);
+    if (n != FILESZ) return -1;
+  }
+  return 0;
+}
+
+int ring(int nfiles, int writing) {
+  int fd[BATCH], res[2 * BATCH];
+  int i, j, n;
+
+  for (i = 0; i < nfiles; i += n) {
+    n = nfiles - i < BATCH ? nfiles - i : BATCH;
+    for (j = 0; j < n; j++) {
+      name(names[j], i + j);
+      push(RING_OPEN, 0, names[j],
+           writing ? O_CREATE | O_TRUNC | O_WRONLY : O_RDONLY);
+    }
+    submit(fd);
+    for (j = 0; j < n; j++) {
+      if (fd[j] < 0) {
+        for (j = 0; j < n; j++)
+          if (fd[j] >= 0) close(fd[j]);
+        return -1;
+      }
+    }
+    for (j = 0; j < n; j++) {
+      push(writing ? RING_WRITE : RING_READ, fd[j], buf, FILESZ);
+      push(RING_CLOSE, fd[j], 0, 0);
+    }
+    submit(res);
+    for (j = 0; j < n; j++)
+      if (res[2 * j] != FILESZ) return -1;
+  }
+  return 0;
+}
+
+void run(char *how, int (*io)(int, int), int nfiles, int writing) {
+  int t0;
+
+  t0 = uptime();
+  if (io(nfiles, writing) < 0) {
+    printf("ringbench: %s %s failed\n", how, writing ? "write" : "read");
+    exit(1);
+  }
+  t0 = uptime() - t0;
+  printf("ringbench: %s: %s %d files in %d ticks\n", how,
+         writing ? "wrote" : "read", nfiles, t0);
+}
+
+int main(int argc, char *argv[]) {
+  int nfiles = argc > 1 ? atoi(argv[1]) : 200;
+  char s[8];
+  int i;
+
+  if (nfiles < 1 || nfiles > 10000) {
+    printf("ringbench: bad file count\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  run("syscalls", syscalls, nfiles, 1);
+  run("syscalls", syscalls, nfiles, 0);
+  run("ring", ring, nfiles, 1);
+  run("ring", ring, nfiles, 0);
+  for (i = 0; i < nfiles; i++) {
+    name(s, i);
+    unlink(s);
+  }
+  exit(0);
+}
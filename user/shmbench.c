@@ -0,0 +1,75 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Ping-pong latency between two processes: one byte each way
+// through a pair of pipes, as pingpong does, against a turn
+// flag in a shared-memory segment that both sides spin on.
+// usage: shmbench [round-trips]
+// The shared-memory side spins, so it needs two or more CPUs.
+
+int pipes(int n) {
+  int ping[2], pong[2], i, t0;
+  char c = 0;
+
+  if (pipe(ping) < 0 || pipe(pong) < 0) {
+    printf("shmbench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if (fork() == 0) {
+    for (i = 0; i < n; i++) {
+      read(ping[0], &c, 1);
+      write(pong[1], &c, 1);
+    }
+    exit(0);
+  }
+  for (i = 0; i < n; i++) {
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  wait(0);
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+  return uptime() - t0;
+}
+
+int shm(int n) {
+  volatile int *turn;
+  int i, t0;
+
+  if ((turn = shmcreate("shmbench", sizeof(int))) == 0) {
+    printf("shmbench: shmcreate failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if (fork() == 0) {
+    for (i = 0; i < n; i++) {
+      while (*turn != 1)
+        ;
+      __sync_synchronize();
+      *turn = 0;
+    }
+    exit(0);
+  }
+  for (i = 0; i < n; i++) {
+    *turn = 1;
+    __sync_synchronize();
+    while (*turn != 0)
+      ;
+  }
+  wait(0);
+  shmdetach((void *)turn);
+  return uptime() - t0;
+}
+
+int main(int argc, char *argv[]) {
+  int n = argc > 1 ? atoi(argv[1]) : 10000;
+  int tp = pipes(n);
+  int ts = shm(n);
+
+  printf("shmbench: %d round trips: pipes %d ticks, shared memory %d ticks\n",
+         n, tp, ts);
+  exit(0);
+}
@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct pollfd;
+struct ring;
 
 // system calls
 int fork(void);
@@ -23,6 +26,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int sendfile(int, int, uint*, int);
+int copy_file_range(int, uint*, int, uint*, int);
+int fcntl(int, int, int);
+int splice(int, uint*, int, uint*, int);
+int vmsplice(int, const struct iovec*, int);
+int poll(struct pollfd*, int, int);
+void* shmcreate(const char*, int);
+void* shmattach(const char*);
+int shmdetach(void*);
+int ring_enter(struct ring*);
 
 // ulib.c
 int stat(const char*, struct stat*);
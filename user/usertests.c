@@ -4,6 +4,9 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
+#include "kernel/poll.h"
+#include "kernel/ring.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -523,6 +526,9 @@ writetest(char *s)
   }
 }
 
+// enough blocks to reach into the doubly-indirect block
+#define BIGBLOCKS (NDIRECT + NINDIRECT + 2*NINDIRECT)
+
 void
 writebig(char *s)
 {
@@ -534,7 +540,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", i);
@@ -554,7 +560,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf("%s: read only %d blocks from big", n);
         exit(1);
       }
@@ -735,6 +741,69 @@ pipe1(char *s)
   }
 }
 
+// pipe capacity can be read and changed with fcntl, keeping
+// what the pipe holds.
+void
+pipesize(char *s)
+{
+  int fds[2], def, i, n, cc, seq;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if((def = fcntl(fds[0], F_GETPIPE_SZ, 0)) < 4000){
+    printf("%s: default pipe size %d\n", s, def);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 40000) != 40960 ||
+     fcntl(fds[0], F_GETPIPE_SZ, 0) != 40960){
+    printf("%s: could not grow the pipe\n", s);
+    exit(1);
+  }
+  // fill it without a reader.
+  seq = 0;
+  for(n = 0; n < 10; n++){
+    for(i = 0; i < 4096; i++)
+      buf[i] = seq++;
+    if(write(fds[1], buf, 4096) != 4096){
+      printf("%s: write to the pipe failed\n", s);
+      exit(1);
+    }
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 100) >= 0){
+    printf("%s: shrank a full pipe\n", s);
+    exit(1);
+  }
+  if(read(fds[0], buf, 1000) != 1000){
+    printf("%s: read from the pipe failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 65536) != 65536){
+    printf("%s: could not grow a non-empty pipe\n", s);
+    exit(1);
+  }
+  seq = 1000;
+  for(n = 1000; n < 40960; n += cc){
+    if((cc = read(fds[0], buf, 4096)) <= 0){
+      printf("%s: read from the pipe failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < cc; i++){
+      if((buf[i] & 0xff) != (seq++ & 0xff)){
+        printf("%s: wrong data after resize\n", s);
+        exit(1);
+      }
+    }
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 1) != def){
+    printf("%s: could not shrink an empty pipe\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -1479,6 +1548,112 @@ bigdir(char *s)
   }
 }
 
+// the FNV-1a hash that hashed directories use for names.
+static uint
+namehash(char *name)
+{
+  uint h = 2166136261;
+
+  for(; *name; name++)
+    h = (h ^ (uchar)*name) * 16777619;
+  return h;
+}
+
+// a hashed directory whose bucket for a name cannot be split
+// any further refuses the name instead of panicking.
+void
+dirfull(char *s)
+{
+  char path[16];
+  struct stat st;
+  int i, n, fd, nlink;
+
+  unlink("dfdir");
+  if(mkdir("dfdir") != 0 || (fd = open("dfdir/f", O_CREATE)) < 0){
+    printf("%s: dirfull setup failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  // enough ordinary names to make the directory hashed.
+  for(i = 0; i < 140; i++){
+    strcpy(path, "dfdir/l");
+    path[7] = '0' + i / 100;
+    path[8] = '0' + i / 10 % 10;
+    path[9] = '0' + i % 10;
+    path[10] = 0;
+    if(link("dfdir/f", path) != 0){
+      printf("%s: link %s failed\n", s, path);
+      exit(1);
+    }
+  }
+
+  // names whose hashes agree in all the bits the table can
+  // use all go to one bucket, until it is full.
+  strcpy(path, "dfdir/");
+  n = 0;
+  for(i = 0; n < 200 && i < 100000; i++){
+    path[6] = 'c';
+    path[7] = '0' + i / 10000;
+    path[8] = '0' + i / 1000 % 10;
+    path[9] = '0' + i / 100 % 10;
+    path[10] = '0' + i / 10 % 10;
+    path[11] = '0' + i % 10;
+    path[12] = 0;
+    if(namehash(path + 6) & 0xff)
+      continue;
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0)
+      break;
+    close(fd);
+    n++;
+  }
+  if(n == 200 || i == 100000){
+    printf("%s: one bucket took %d names\n", s, n);
+    exit(1);
+  }
+  if(open(path, O_RDONLY) >= 0){
+    printf("%s: refused name %s exists\n", s, path);
+    exit(1);
+  }
+
+  // mkdir must fail the same way, and leave the parent's
+  // link count as it was.
+  if(stat("dfdir", &st) < 0){
+    printf("%s: stat dfdir failed\n", s);
+    exit(1);
+  }
+  nlink = st.nlink;
+  if(mkdir(path) == 0 || stat("dfdir", &st) < 0 || st.nlink != nlink){
+    printf("%s: mkdir in a full bucket misbehaved\n", s);
+    exit(1);
+  }
+
+  // clean up.
+  for(i--; i >= 0; i--){
+    path[7] = '0' + i / 10000;
+    path[8] = '0' + i / 1000 % 10;
+    path[9] = '0' + i / 100 % 10;
+    path[10] = '0' + i / 10 % 10;
+    path[11] = '0' + i % 10;
+    if((namehash(path + 6) & 0xff) == 0 && unlink(path) != 0){
+      printf("%s: unlink %s failed\n", s, path);
+      exit(1);
+    }
+  }
+  for(i = 0; i < 140; i++){
+    strcpy(path, "dfdir/l");
+    path[7] = '0' + i / 100;
+    path[8] = '0' + i / 10 % 10;
+    path[9] = '0' + i % 10;
+    path[10] = 0;
+    unlink(path);
+  }
+  unlink("dfdir/f");
+  if(unlink("dfdir") != 0){
+    printf("%s: unlink dfdir failed\n", s);
+    exit(1);
+  }
+}
+
 void
 subdir(char *s)
 {
@@ -1737,6 +1912,619 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// two extent-mapped files written a block at a time in turn,
+// so that neither can grow in place and their extent maps
+// spill into extent blocks.
+void
+extentfile(char *s)
+{
+  enum { N = 200 };
+  int fd[2], i, j;
+
+  for(j = 0; j < 2; j++){
+    char name[] = { 'x', 'f', '0' + j, 0 };
+    unlink(name);
+    fd[j] = open(name, O_CREATE | O_RDWR | O_EXTENT);
+    if(fd[j] < 0){
+      printf("%s: cannot create %s\n", s, name);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    for(j = 0; j < 2; j++){
+      memset(buf, 0, BSIZE);
+      ((int*)buf)[0] = i;
+      ((int*)buf)[1] = j;
+      if(write(fd[j], buf, BSIZE) != BSIZE){
+        printf("%s: write extent file failed\n", s);
+        exit(1);
+      }
+    }
+  }
+  for(j = 0; j < 2; j++){
+    close(fd[j]);
+    char name[] = { 'x', 'f', '0' + j, 0 };
+    fd[j] = open(name, O_RDONLY);
+    for(i = 0; i < N; i++){
+      if(read(fd[j], buf, BSIZE) != BSIZE ||
+         ((int*)buf)[0] != i || ((int*)buf)[1] != j){
+        printf("%s: read extent file %d block %d wrong\n", s, j, i);
+        exit(1);
+      }
+    }
+    if(read(fd[j], buf, BSIZE) != 0){
+      printf("%s: extent file too long\n", s);
+      exit(1);
+    }
+    close(fd[j]);
+    if(unlink(name) < 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+}
+
+// path lookups that the directory entry cache answers must
+// follow creates and unlinks, including of names that were
+// looked up before they existed.
+void
+dcachetest(char *s)
+{
+  int fd, i;
+
+  unlink("dcd/f");
+  unlink("dcd");
+  for(i = 0; i < 2; i++){
+    if(open("dcd/f", O_RDONLY) >= 0){
+      printf("%s: open of missing dcd/f succeeded\n", s);
+      exit(1);
+    }
+    if(mkdir("dcd") < 0){
+      printf("%s: mkdir dcd failed\n", s);
+      exit(1);
+    }
+    if(open("dcd/f", O_RDONLY) >= 0){
+      printf("%s: open of missing dcd/f succeeded\n", s);
+      exit(1);
+    }
+    fd = open("dcd/f", O_CREATE | O_RDWR);
+    if(fd < 0){
+      printf("%s: create dcd/f failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    fd = open("dcd/f", O_RDONLY);
+    if(fd < 0){
+      printf("%s: open of dcd/f failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(unlink("dcd/f") < 0 || open("dcd/f", O_RDONLY) >= 0){
+      printf("%s: dcd/f still there after unlink\n", s);
+      exit(1);
+    }
+    if(unlink("dcd") < 0){
+      printf("%s: unlink dcd failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// file reads are served from the page cache once a page is
+// cached; writes, appends past a cached page's end, and
+// truncation must all show through it.
+void
+pcachetest(char *s)
+{
+  int fd, i, n;
+
+  fd = open("pcf", O_CREATE | O_TRUNC | O_RDWR);
+  if(fd < 0){
+    printf("%s: create pcf failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', 3000);
+  if(write(fd, buf, 3000) != 3000){
+    printf("%s: write pcf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // cache the first page, then overwrite and extend it.
+  fd = open("pcf", O_RDWR);
+  if(read(fd, buf, BUFSZ) != 3000){
+    printf("%s: read pcf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pcf", O_RDWR);
+  memset(buf, 'b', 1500);
+  memset(buf+1500, 'c', 3500);
+  if(write(fd, buf, 5000) != 5000){
+    printf("%s: rewrite pcf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < 2; i++){
+    memset(buf, 0, BUFSZ);
+    fd = open("pcf", O_RDONLY);
+    if((n = read(fd, buf, BUFSZ)) != 5000){
+      printf("%s: read %d bytes of pcf, not 5000\n", s, n);
+      exit(1);
+    }
+    close(fd);
+    for(n = 0; n < 5000; n++){
+      if(buf[n] != (n < 1500 ? 'b' : 'c')){
+        printf("%s: pcf[%d] is %d\n", s, n, buf[n]);
+        exit(1);
+      }
+    }
+  }
+
+  fd = open("pcf", O_RDWR | O_TRUNC);
+  if(write(fd, "d", 1) != 1){
+    printf("%s: write after truncate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pcf", O_RDONLY);
+  if(read(fd, buf, BUFSZ) != 1 || buf[0] != 'd'){
+    printf("%s: pcf wrong after truncate\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("pcf");
+}
+
+// pread/pwrite at explicit offsets leave the file offset
+// alone; readv/writev move it across all their buffers.
+void
+vectorio(char *s)
+{
+  int fd, fds[2];
+  char a[4], b[10];
+  struct iovec iov[3];
+
+  fd = open("viof", O_CREATE | O_TRUNC | O_RDWR);
+  if(fd < 0){
+    printf("%s: create viof failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = "";
+  iov[1].iov_len = 0;
+  iov[2].iov_base = "defgh";
+  iov[2].iov_len = 5;
+  if(writev(fd, iov, 3) != 8){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "XY", 2, 2) != 2){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, a, 4, 1) != 4 || memcmp(a, "bXYe", 4) != 0){
+    printf("%s: pread read wrong data\n", s);
+    exit(1);
+  }
+  if(write(fd, "Z", 1) != 1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, a, 4, 9) != 0){
+    printf("%s: pread past the end read data\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("viof", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof(b);
+  if(readv(fd, iov, 2) != 9 || memcmp(a, "abXY", 4) != 0 ||
+     memcmp(b, "efghZ", 5) != 0){
+    printf("%s: readv read wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("viof");
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fds[1], "x", 1, 0) >= 0 || pread(fds[0], a, 1, 0) >= 0){
+    printf("%s: pread/pwrite on a pipe succeeded\n", s);
+    exit(1);
+  }
+  // the pipe runs dry after the first buffer; readv must not wait.
+  if(write(fds[1], "pipe", 4) != 4 || readv(fds[0], iov, 2) != 4 ||
+     memcmp(a, "pipe", 4) != 0){
+    printf("%s: readv on a pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// sendfile and copy_file_range copy between files and into
+// pipes inside the kernel.
+void
+copyrange(char *s)
+{
+  int in, out, fds[2], i, n;
+  uint inoff, outoff;
+
+  unlink("crout");
+  in = open("crin", O_CREATE | O_TRUNC | O_RDWR);
+  out = open("crout", O_CREATE | O_RDWR);
+  if(in < 0 || out < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3000; i++)
+    buf[i] = i % 251;
+  if(write(in, buf, 3000) != 3000){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+
+  // from the start of in to the current offset of out.
+  inoff = 0;
+  if((n = copy_file_range(in, &inoff, out, 0, BUFSZ)) != 3000 || inoff != 3000){
+    printf("%s: copy_file_range copied %d, not 3000\n", s, n);
+    exit(1);
+  }
+  // part of in appended at an explicit offset of out.
+  inoff = 1000;
+  outoff = 3000;
+  if(copy_file_range(in, &inoff, out, &outoff, 500) != 500 ||
+     inoff != 1500 || outoff != 3500){
+    printf("%s: copy_file_range at offsets failed\n", s);
+    exit(1);
+  }
+  close(out);
+  out = open("crout", O_RDONLY);
+  memset(buf, 0, BUFSZ);
+  if(read(out, buf, BUFSZ) != 3500){
+    printf("%s: crout has the wrong size\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3500; i++){
+    if((uchar)buf[i] != (i < 3000 ? i : i - 2000) % 251){
+      printf("%s: crout[%d] is wrong\n", s, i);
+      exit(1);
+    }
+  }
+  close(out);
+  unlink("crout");
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  inoff = 2000;
+  if(sendfile(fds[1], in, &inoff, 100) != 100 || inoff != 2100){
+    printf("%s: sendfile to a pipe failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], buf, 100) != 100 || (uchar)buf[0] != 2000 % 251 ||
+     (uchar)buf[99] != 2099 % 251){
+    printf("%s: pipe has the wrong data\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(in);
+  unlink("crin");
+}
+
+// splice moves bytes from a file into a pipe and from a pipe
+// into a file; vmsplice writes user buffers into a pipe.
+void
+splicetest(char *s)
+{
+  int in, out, fds[2], i;
+  uint off;
+  struct iovec iov;
+
+  in = open("spin", O_CREATE | O_TRUNC | O_RDWR);
+  out = open("spout", O_CREATE | O_TRUNC | O_RDWR);
+  if(in < 0 || out < 0 || pipe(fds) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 5000; i++)
+    buf[i] = i % 253;
+  if(write(in, buf, 5000) != 5000){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+
+  off = 1000;
+  if(splice(in, &off, fds[1], 0, 3000) != 3000 || off != 4000){
+    printf("%s: splice from a file failed\n", s);
+    exit(1);
+  }
+  if(splice(fds[0], 0, out, 0, BUFSZ) != 3000){
+    printf("%s: splice to a file failed\n", s);
+    exit(1);
+  }
+  if(splice(in, 0, out, 0, 10) >= 0){
+    printf("%s: splice without a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(out);
+  out = open("spout", O_RDONLY);
+  if(read(out, buf, BUFSZ) != 3000){
+    printf("%s: spout has the wrong size\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3000; i++){
+    if((uchar)buf[i] != (i + 1000) % 253){
+      printf("%s: spout[%d] is wrong\n", s, i);
+      exit(1);
+    }
+  }
+
+  iov.iov_base = "hello";
+  iov.iov_len = 5;
+  if(vmsplice(fds[1], &iov, 1) != 5 || read(fds[0], buf, 10) != 5 ||
+     memcmp(buf, "hello", 5) != 0){
+    printf("%s: vmsplice failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(in);
+  close(out);
+  unlink("spin");
+  unlink("spout");
+}
+
+// poll waits for whichever of several pipes becomes ready.
+void
+polltest(char *s)
+{
+  int a[2], b[2], pid, xstatus;
+  struct pollfd fds[3];
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fds[0].fd = a[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = b[0];
+  fds[1].events = POLLIN;
+  fds[2].fd = a[1];
+  fds[2].events = POLLOUT;
+  if(poll(fds, 3, 0) != 1 || fds[0].revents || fds[1].revents ||
+     fds[2].revents != POLLOUT){
+    printf("%s: poll of idle pipes is wrong\n", s);
+    exit(1);
+  }
+  if(poll(fds, 2, 2) != 0){
+    printf("%s: poll did not time out\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  if(poll(fds, 2, -1) != 1 || fds[0].revents || fds[1].revents != POLLIN){
+    printf("%s: poll missed the write\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  close(a[1]);
+  fds[2].fd = NOFILE - 1;
+  if(poll(fds, 3, -1) != 3 || !(fds[0].revents & POLLHUP) ||
+     fds[2].revents != POLLNVAL){
+    printf("%s: poll missed a close\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  close(b[0]);
+  close(b[1]);
+}
+
+// reads and writes of O_NONBLOCK pipes return EWOULDBLOCK
+// instead of waiting.
+void
+nonblock(char *s)
+{
+  int fds[2], size, n;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+     fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0 ||
+     fcntl(fds[0], F_GETFL, 0) != O_NONBLOCK){
+    printf("%s: fcntl F_SETFL failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], buf, 1) != EWOULDBLOCK){
+    printf("%s: read of an empty pipe did not fail\n", s);
+    exit(1);
+  }
+  size = fcntl(fds[1], F_GETPIPE_SZ, 0);
+  if(size > BUFSZ || (n = write(fds[1], buf, BUFSZ)) != size){
+    printf("%s: write to the pipe wrote %d, not %d\n", s, n, size);
+    exit(1);
+  }
+  if(write(fds[1], buf, 1) != EWOULDBLOCK){
+    printf("%s: write to a full pipe did not fail\n", s);
+    exit(1);
+  }
+  if(read(fds[0], buf, BUFSZ) != size){
+    printf("%s: read of the pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  if(read(fds[0], buf, 1) != 0){
+    printf("%s: read of a closed pipe did not return 0\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
+// a shared-memory segment is seen by a forked child and by
+// another attachment, and goes away with its last detach.
+void
+shmtest(char *s)
+{
+  char *p, *q;
+  int pid, xstatus;
+
+  if((p = shmcreate("ushm", 6000)) == 0){
+    printf("%s: shmcreate failed\n", s);
+    exit(1);
+  }
+  if(shmcreate("ushm", 100) != 0){
+    printf("%s: created ushm twice\n", s);
+    exit(1);
+  }
+  p[0] = 'a';
+  p[5999] = 'b';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if((q = shmattach("ushm")) == 0 || q == p ||
+       q[0] != 'a' || q[5999] != 'b' || p[0] != 'a'){
+      printf("%s: child does not see the segment\n", s);
+      exit(1);
+    }
+    q[1] = 'c';
+    p[2] = 'd';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(p[1] != 'c' || p[2] != 'd'){
+    printf("%s: parent does not see the child's writes\n", s);
+    exit(1);
+  }
+  if(shmdetach(p) < 0 || shmdetach(p) == 0){
+    printf("%s: shmdetach failed\n", s);
+    exit(1);
+  }
+  if(shmattach("ushm") != 0){
+    printf("%s: ushm still there after the last detach\n", s);
+    exit(1);
+  }
+}
+
+static void
+ringpush(struct ring *r, int op, int fd, void *addr, int len, uint off)
+{
+  struct ringsqe *e = &r->sq[r->sqtail % RINGSIZE];
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->len = len;
+  e->off = off;
+  e->data = r->sqtail;
+  r->sqtail++;
+}
+
+// reap the next completion, checking it belongs to request i.
+static int
+ringpop(struct ring *r, uint i, char *s)
+{
+  struct ringcqe *c;
+
+  if(r->cqhead == r->cqtail || (c = &r->cq[r->cqhead % RINGSIZE])->data != i){
+    printf("%s: missing completion %d\n", s, i);
+    exit(1);
+  }
+  r->cqhead++;
+  return c->res;
+}
+
+// batched I/O through the submission ring.
+void
+ringtest(char *s)
+{
+  static struct ring r;
+  char buf[16];
+  int fd, i;
+
+  unlink("ringf");
+  ringpush(&r, RING_OPEN, 0, "ringf", O_CREATE|O_RDWR, 0);
+  ringpush(&r, RING_NOP, 0, 0, 0, 0);
+  if(ring_enter(&r) != 2 || r.sqhead != 2 || (fd = ringpop(&r, 0, s)) < 0 ||
+     ringpop(&r, 1, s) != 0){
+    printf("%s: ring open failed\n", s);
+    exit(1);
+  }
+
+  ringpush(&r, RING_WRITE, fd, "hello", 5, RING_CUROFF);
+  ringpush(&r, RING_WRITE, fd, "HE", 2, 0);
+  ringpush(&r, RING_WRITE, fd, "!", 1, RING_CUROFF);
+  ringpush(&r, RING_FSYNC, fd, 0, 0, 0);
+  ringpush(&r, RING_READ, fd, buf, sizeof(buf), 1);
+  ringpush(&r, RING_CLOSE, fd, 0, 0, 0);
+  ringpush(&r, RING_READ, fd, buf, sizeof(buf), 0);
+  if(ring_enter(&r) != 7){
+    printf("%s: ring_enter did not take the batch\n", s);
+    exit(1);
+  }
+  if(ringpop(&r, 2, s) != 5 || ringpop(&r, 3, s) != 2 || ringpop(&r, 4, s) != 1 ||
+     ringpop(&r, 5, s) != 0 || ringpop(&r, 6, s) != 5 || ringpop(&r, 7, s) != 0 ||
+     ringpop(&r, 8, s) != -1){
+    printf("%s: wrong ring results\n", s);
+    exit(1);
+  }
+  if(memcmp(buf, "Ello!", 5) != 0){
+    printf("%s: ring read back wrong data\n", s);
+    exit(1);
+  }
+  if(close(fd) == 0){
+    printf("%s: RING_CLOSE left the fd open\n", s);
+    exit(1);
+  }
+
+  // stops while the completion queue is full.
+  ringpush(&r, RING_NOP, 0, 0, 0, 0);
+  if(ring_enter(&r) != 1){
+    printf("%s: ring nop failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < RINGSIZE; i++)
+    ringpush(&r, RING_NOP, 0, 0, 0, 0);
+  if(ring_enter(&r) != RINGSIZE-1 || r.sqtail - r.sqhead != 1){
+    printf("%s: ring overran the completion queue\n", s);
+    exit(1);
+  }
+  for(i = 0; i < RINGSIZE; i++)
+    ringpop(&r, 9 + i, s);
+  if(ring_enter(&r) != 1 || ringpop(&r, 9 + RINGSIZE, s) != 0){
+    printf("%s: ring did not resume\n", s);
+    exit(1);
+  }
+  unlink("ringf");
+}
+
 void
 fourteen(char *s)
 {
@@ -2685,15 +3473,27 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipesize, "pipesize"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
     {fourteen, "fourteen"},
     {bigfile, "bigfile"},
+    {extentfile, "extentfile"},
+    {dcachetest, "dcachetest"},
+    {pcachetest, "pcachetest"},
+    {vectorio, "vectorio"},
+    {copyrange, "copyrange"},
+    {splicetest, "splicetest"},
+    {polltest, "polltest"},
+    {nonblock, "nonblock"},
+    {shmtest, "shmtest"},
+    {ringtest, "ringtest"},
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
     {bigdir, "bigdir"}, // slow
+    {dirfull, "dirfull"},
     { 0, 0},
   };
 
@@ -36,3 +36,17 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("sendfile");
+entry("copy_file_range");
+entry("fcntl");
+entry("splice");
+entry("vmsplice");
+entry("poll");
+entry("shmcreate");
+entry("shmattach");
+entry("shmdetach");
+entry("ring_enter");